@@ -9,12 +9,13 @@ extern std::string g_algname;
 extern boost::filesystem::path g_srcbin;
 extern boost::filesystem::path g_config;
 extern size_t g_distr_size;
+extern boost::optional<fxlib::fxsession_mask> g_sessions;
 
 using boost::posix_time::minutes;
 using boost::posix_time::seconds;
 using boost::posix_time::time_duration;
 
-fxlib::fxsequence LoadingQuotes(const boost::filesystem::path& srcbin);
+fxlib::fxsequence_reader OpeningQuotes(const boost::filesystem::path& srcbin);
 
 bool CheckPos(const boost::posix_time::ptime pos, const fxlib::markers& marks, const time_duration window) {
     auto icandidate = std::lower_bound(marks.cbegin(), marks.cend(), pos);
@@ -30,14 +31,14 @@ void Analyze(const boost::property_tree::ptree& prop) {
     if (!forecaster) {
         throw invalid_argument("Could not create algorithm '" + g_algname + "'");
     }
-    const fxlib::fxsequence seq = LoadingQuotes(g_srcbin);
+    fxlib::fxsequence_reader reader = OpeningQuotes(g_srcbin);
     const fxlib::ForecastInfo info = forecaster->Info();
     fxlib::fprofit_t profit = info.position == fxlib::fxposition::fxlong ? fxlib::fxprofit_long : fxlib::fxprofit_short;
     cout << "Markup of rate sequence... " << endl;
     double time_adjust;
     double probab;
     double durat;
-    auto marks = fxlib::GenuinePositions(seq, info.timeout, profit, info.margin * g_pip, time_adjust, probab, durat);
+    auto marks = fxlib::GenuinePositions(reader, info.timeout, profit, info.margin * g_pip, time_adjust, probab, durat);
     const time_duration wait_operation = seconds(static_cast<long>(time_adjust * 60.0 / probab));
     const time_duration wait_margin = seconds(static_cast<long>(60.0 * durat));
     cout << "Geniune positions: " << marks.size() << endl;
@@ -53,40 +54,49 @@ void Analyze(const boost::property_tree::ptree& prop) {
     vector<size_t> Nfr(g_distr_size + 1);  // False rejection
     size_t curr_idx = 0;
     int progress = 1;
-    size_t progress_idx = (progress * seq.candles.size()) / 10;
-    for (auto piter = seq.candles.begin();
-         piter < seq.candles.end() && piter->time <= (seq.candles.back().time - info.timeout - info.window);
-         ++piter, ++curr_idx, ++N) {
-        if (curr_idx == progress_idx) {
-            cout << piter->time << " processed " << (progress * 10) << "%" << endl;
-            progress_idx = (++progress * seq.candles.size()) / 10;
-        }
-        const double est = forecaster->Feed(*piter);
-        const bool genuine = CheckPos(piter->time, marks, info.window);
-        if (genuine) {
-            Ngp++;
-        }
-        for (size_t i = 0; i <= g_distr_size; i++) {
-            const bool pcast = est >= (double(i) / double(g_distr_size));
-            if (pcast) {
-                if (last_positive_cast[i].is_initialized()) {
-                    const time_duration dt = piter->time - *last_positive_cast[i];
-                    actual_wait_operation[i] += dt.total_seconds() / 60.0;
-                }
-                last_positive_cast[i] = piter->time;
-                Np[i]++;
+    size_t progress_idx = (progress * reader.size()) / 10;
+    const boost::posix_time::ptime last_time = reader.last_time() - info.timeout - info.window;
+    const fxlib::fxcalendar calendar(reader.period());
+    const fxlib::fxsession_filter sessions(reader.period(), g_sessions);
+    vector<fxlib::fxcandle> batch;
+    reader.rewind();
+    while (reader.next_batch(batch) && batch.front().time <= last_time) {
+        for (auto piter = batch.cbegin(); piter < batch.cend() && piter->time <= last_time; ++piter, ++curr_idx) {
+            if (curr_idx == progress_idx) {
+                cout << piter->time << " processed " << (progress * 10) << "%" << endl;
+                progress_idx = (++progress * reader.size()) / 10;
+            }
+            const double est = forecaster->Feed(*piter);
+            if (!sessions.accepts(piter->time)) {
+                continue;
             }
+            N++;
+            const bool genuine = CheckPos(piter->time, marks, info.window);
             if (genuine) {
-                if (!pcast) {
-                    Nfr[i]++;
-                }
-            } else {
+                Ngp++;
+            }
+            for (size_t i = 0; i <= g_distr_size; i++) {
+                const bool pcast = est >= (double(i) / double(g_distr_size));
                 if (pcast) {
-                    Nfa[i]++;
+                    if (last_positive_cast[i].is_initialized()) {
+                        const time_duration dt = calendar.open_time(*last_positive_cast[i], piter->time);
+                        actual_wait_operation[i] += dt.total_seconds() / 60.0;
+                    }
+                    last_positive_cast[i] = piter->time;
+                    Np[i]++;
+                }
+                if (genuine) {
+                    if (!pcast) {
+                        Nfr[i]++;
+                    }
+                } else {
+                    if (pcast) {
+                        Nfa[i]++;
+                    }
                 }
             }
         }
-    }
+    }  // while reader
     cout << "Done" << endl;
     cout << "Number of casts: " << N << endl;
     cout << "----------------------------------" << endl;
@@ -1,5 +1,6 @@
 #include "fxlib/fxlib.h"
 #include "fxlib/helpers/program_options.h"
+#include "fxlib/helpers/string_conversion.h"
 #include <boost/filesystem.hpp>
 
 boost::filesystem::path g_srcbin;
@@ -13,6 +14,20 @@ bool g_learn_mode = false;
 bool g_markup_submode = false;
 bool g_training_submode = false;
 size_t g_distr_size = 100;
+// Sessions to filter candles, no filtering by default.
+boost::optional<fxlib::fxsession_mask> g_sessions;
+// Days of quotes to be loaded, the whole sequence by default.
+boost::gregorian::date_period g_period(boost::gregorian::date(boost::date_time::min_date_time),
+                                       boost::gregorian::date(boost::date_time::max_date_time));
+
+void SetFromDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(boost::gregorian::from_simple_string(str), g_period.end());
+}
+
+void SetToDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(g_period.begin(),
+                                             boost::gregorian::from_simple_string(str) + boost::gregorian::days(1));
+}
 
 bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
     using namespace std;
@@ -34,7 +49,14 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
                                    [](const string& srcname) { g_srcbin = boost::filesystem::canonical(srcname); }),
                                "Path to source binary quotes.")(
         "distsize,d", value<size_t>(&g_distr_size)->default_value(100)->value_name("size"),
-        "Number of intervals to build a distribution.");
+        "Number of intervals to build a distribution.")(
+        "sessions", value<string>()->value_name("names")->notifier([](const string& names) {
+            g_sessions = fxlib::conversion::sessions_from_string(names);
+        }),
+        "Count casts only in the sessions (sydney,tokyo,london,newyork), at any time by default "
+        "(DST rules since 2001).")(
+        "from", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetFromDate), "First day of quotes to load.")(
+        "to", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetToDate), "Last day of quotes to load.");
     options_description learn_desc("Learning options", 200);
     learn_desc.add_options()("markup,m", bool_switch(&g_markup_submode), "Preparation training set.")(
         "training,t", bool_switch(&g_training_submode), "Training the algorithm.");
@@ -47,7 +69,9 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
         value<string>()->required()->value_name("filename")->implicit_value("")->notifier([](const string& outname) {
             g_outbin = boost::filesystem::canonical(outname);
         }),
-        "Binary file to write training set.");
+        "Binary file to write training set.")(
+        "from", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetFromDate), "First day of quotes to load.")(
+        "to", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetToDate), "Last day of quotes to load.");
     options_description train_desc("Training options", 200);
     train_desc.add_options()("source,s",
                              value<string>()->required()->value_name("bin")->notifier(
@@ -8,6 +8,7 @@ extern boost::filesystem::path g_config;
 extern std::string g_algname;
 
 fxlib::fxsequence LoadingQuotes(const boost::filesystem::path& srcbin);
+fxlib::fxpyramid LoadingPyramid(const boost::filesystem::path& srcbin);
 
 void Markup(const boost::property_tree::ptree& prop) {
     using namespace std;
@@ -29,5 +30,5 @@ void Markup(const boost::property_tree::ptree& prop) {
         throw invalid_argument("Could not create algorithm trainer '" + g_algname + "'");
     }
     const fxlib::fxsequence seq = LoadingQuotes(g_srcbin);
-    trainer->PrepareTrainingSet(seq, fbin);
+    trainer->PrepareTrainingSet(seq, LoadingPyramid(g_srcbin), fbin);
 }
@@ -2,6 +2,12 @@
 
 #include <gtest/gtest.h>
 
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <utility>
@@ -83,3 +89,97 @@ TEST_F(finam_test_fixture, check_parsing) {
         }
     }
 }
+
+TEST_F(finam_test_fixture, make_from_finam) {
+    using fxlib::MakeFromFinam;
+    using fxlib::detail::make_from_finam_regex;
+    const std::string pair_name = "usdjpy";
+    std::vector<std::string> lines = {
+        "USDJPY 1 170622 0631 111.0840000 111.1100000 111.0440000 111.1070000 711",
+        "USDJPY 1 170622 0631 1. 0.1 00.0012345678901234567 123456789012345678.5 0",
+        "USDJPY\t1 \r\n170622 0631 111.084 111.11 111.044 111.107 18446744073709551615",
+        "USDJPY 1 170622 0631 111.084 111.11 111.044 111.107 18446744073709551616",
+        "USDJPY 01 170622 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 2 170622 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 99999999999 170622 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 171322 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 170632 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 170229 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 170600 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 170622 2599 111.084 111.11 111.044 111.107 711",
+        "EURJPY 1 170622 0631 111.084 111.11 111.044 111.107 711",
+        "USDJPY 1 170622 0631 111.084 111.11 111.044 111.107 711\n",
+        ""};
+    lines.insert(lines.end(), invalid_finam_lines.begin(), invalid_finam_lines.end());
+    for (const auto& line : lines) {
+        std::string expected_error;
+        fxlib::fxcandle expected{};
+        try {
+            expected = make_from_finam_regex(line, pair_name);
+        } catch (const std::logic_error& e) {
+            expected_error = e.what();
+        }
+        std::string error;
+        fxlib::fxcandle candle{};
+        try {
+            candle = MakeFromFinam(line, pair_name);
+        } catch (const std::logic_error& e) {
+            error = e.what();
+        }
+        EXPECT_EQ(expected_error, error) << line;
+        if (expected_error.empty()) {
+            EXPECT_EQ(expected.time, candle.time) << line;
+            EXPECT_EQ(expected.open, candle.open) << line;
+            EXPECT_EQ(expected.close, candle.close) << line;
+            EXPECT_EQ(expected.high, candle.high) << line;
+            EXPECT_EQ(expected.low, candle.low) << line;
+            EXPECT_EQ(expected.volume, candle.volume) << line;
+        }
+    }
+}
+
+// Disabled by default, run by --gtest_also_run_disabled_tests.
+TEST_F(finam_test_fixture, DISABLED_make_from_finam_benchmark) {
+    namespace fs = boost::filesystem;
+    using clock = std::chrono::steady_clock;
+    const fs::path bases = fs::path(__FILE__).parent_path() / ".." / ".." / "quote-bases";
+    ASSERT_TRUE(fs::is_directory(bases)) << bases << " not found";
+    std::vector<std::pair<std::string, std::string>> lines;
+    for (const auto& entry : fs::directory_iterator(bases)) {
+        std::ifstream fin(entry.path().string());
+        const std::string pair_name = entry.path().filename().string().substr(0, 6);
+        std::string line;
+        std::getline(fin, line);  // header
+        while (std::getline(fin, line)) {
+            lines.emplace_back(line, pair_name);
+        }
+    }
+    ASSERT_FALSE(lines.empty());
+
+    std::vector<fxlib::fxcandle> regex_candles;
+    std::vector<fxlib::fxcandle> candles;
+    regex_candles.reserve(lines.size());
+    candles.reserve(lines.size());
+    const auto t0 = clock::now();
+    for (const auto& line : lines) {
+        regex_candles.push_back(fxlib::detail::make_from_finam_regex(line.first, line.second));
+    }
+    const auto t1 = clock::now();
+    for (const auto& line : lines) {
+        candles.push_back(fxlib::MakeFromFinam(line.first, line.second));
+    }
+    const auto t2 = clock::now();
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_EQ(regex_candles[i].time, candles[i].time);
+        ASSERT_EQ(regex_candles[i].open, candles[i].open);
+        ASSERT_EQ(regex_candles[i].close, candles[i].close);
+        ASSERT_EQ(regex_candles[i].high, candles[i].high);
+        ASSERT_EQ(regex_candles[i].low, candles[i].low);
+        ASSERT_EQ(regex_candles[i].volume, candles[i].volume);
+    }
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Lines: " << lines.size() << std::endl;
+    std::cout << "Parse: regex " << ms(t1 - t0).count() << " ms, hand-written " << ms(t2 - t1).count() << " ms"
+              << std::endl;
+}
@@ -0,0 +1,181 @@
+#include "fxlib/fxanalysis.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fxlib {
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+
+class fxanalysis_test_fixture : public ::testing::Test {
+ protected:
+    // Random walk of minute quotes with gaps, prices in 1e-5.
+    fxsequence make_walk(int ndays = 7) const {
+        fxsequence seq = {minutes(1), date_period(date(2015, Jan, 5), days(ndays)), {}};
+        uint32_t state = 12345;
+        int64_t walk = 110000;
+        for (int i = 0; i < ndays * 1440; i++) {
+            state = state * 1103515245 + 12345;
+            if ((state >> 16) % 17 == 3) {
+                continue;  // gaps in quotes
+            }
+            const int64_t open = walk;
+            walk += static_cast<int64_t>((state >> 8) % 21) - 10;
+            const double rate = open * 1e-5;
+            const double close = walk * 1e-5;
+            seq.candles.push_back({ptime(seq.period.begin(), minutes(i + 1)), rate, close,
+                                   std::max(rate, close) + 2e-5, std::min(rate, close) - 2e-5, size_t(i % 50)});
+        }
+        return seq;
+    }
+
+    // Scan of the timeout after every open candidate, the reference for GenuinePositions.
+    static markers scan_positions(const fxseries& ser, fxminutes span, fprofit_mean_t profit, double margin,
+                                  size_t& count, double& durat) {
+        markers marks;
+        count = 0;
+        durat = 0;
+        for (size_t iopen = 0; iopen < ser.size() && ser.minute.back() - ser.minute[iopen] >= span; ++iopen, ++count) {
+            for (size_t iclose = iopen + 1; iclose < ser.size() && ser.minute[iclose] - ser.minute[iopen] <= span;
+                 ++iclose) {
+                if (profit(ser.mean[iclose], ser.mean[iopen]) >= margin) {
+                    durat += static_cast<double>(ser.minute[iclose] - ser.minute[iopen]);
+                    marks.push_back(ser.time[iopen]);
+                    break;
+                }
+            }
+        }
+        durat /= marks.empty() ? 1 : marks.size();
+        return marks;
+    }
+};
+
+TEST_F(fxanalysis_test_fixture, genuine_positions) {
+    const boost::filesystem::path filename =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("fxanalysis-%%%%-%%%%.bin");
+    {
+        std::ofstream out(filename.string(), std::ofstream::binary | std::ofstream::trunc);
+        ASSERT_NO_THROW(WriteSequence(out, make_walk(), fxformat::fxcompressed));
+    }
+    // Prices of the file are decoded from millionth, so all the overloads are given the same quotes.
+    const fxsequence seq = ReadSequence(fxsequence_view(filename.string()));
+    const fxseries ser = MakeSeries(seq);
+    {
+        fxsequence_reader reader(filename.string());
+        for (const int timeout : {1, 30, 240, 1440}) {
+            for (const double margin : {0.0, 0.0005, 0.002}) {
+                for (const bool long_position : {true, false}) {
+                    const fprofit_t profit = long_position ? fxprofit_long : fxprofit_short;
+                    const fprofit_mean_t profit_mean = long_position ? fxprofit_mean_long : fxprofit_mean_short;
+                    size_t count;
+                    double scan_durat;
+                    const markers scan = scan_positions(ser, timeout, profit_mean, margin, count, scan_durat);
+                    double adjust[3];
+                    double probab[3];
+                    double durat[3];
+                    const markers marks[] = {
+                        GenuinePositions(seq, minutes(timeout), profit, margin, adjust[0], probab[0], durat[0]),
+                        GenuinePositions(ser, minutes(timeout), profit_mean, margin, adjust[1], probab[1], durat[1]),
+                        GenuinePositions(reader, minutes(timeout), profit, margin, adjust[2], probab[2], durat[2])};
+                    for (int i = 0; i < 3; i++) {
+                        EXPECT_EQ(scan, marks[i]) << "timeout " << timeout << ", margin " << margin;
+                        EXPECT_EQ(scan_durat, durat[i]);
+                        EXPECT_EQ(double(scan.size()) / double(count), probab[i]);
+                        EXPECT_EQ(adjust[0], adjust[i]);
+                    }
+                }
+            }
+        }
+    }
+    boost::filesystem::remove(filename);
+}
+
+TEST_F(fxanalysis_test_fixture, genuine_positions_sweep) {
+    const fxsequence seq = make_walk();
+    const fxseries ser = MakeSeries(seq);
+    const std::vector<double> margins = {0.0, 0.0001, 0.0005, 0.0005, 0.001, 0.002, 0.01};
+    for (const int timeout : {1, 60, 1440}) {
+        const auto seq_sweep = GenuinePositions(seq, minutes(timeout), fxprofit_short, margins);
+        const auto ser_sweep = GenuinePositions(ser, minutes(timeout), fxprofit_mean_short, margins);
+        ASSERT_EQ(margins.size(), seq_sweep.size());
+        ASSERT_EQ(margins.size(), ser_sweep.size());
+        for (size_t k = 0; k < margins.size(); k++) {
+            double adjust, probab, durat;
+            const markers marks =
+                GenuinePositions(seq, minutes(timeout), fxprofit_short, margins[k], adjust, probab, durat);
+            for (const auto& positions : {seq_sweep[k], ser_sweep[k]}) {
+                EXPECT_EQ(margins[k], positions.margin);
+                EXPECT_EQ(marks, positions.marks) << "timeout " << timeout << ", margin " << margins[k];
+                EXPECT_EQ(adjust, positions.adjust);
+                EXPECT_EQ(probab, positions.probab);
+                EXPECT_EQ(durat, positions.durat);
+            }
+        }
+    }
+    // A hand-built sequence may have candles out of its period.
+    fxsequence unbound = seq;
+    unbound.period = date_period(date(2015, Jan, 6), date(2015, Jan, 6));
+    double adjust, probab, durat;
+    const markers marks = GenuinePositions(seq, minutes(60), fxprofit_short, 0.0005, adjust, probab, durat);
+    double unbound_adjust, unbound_probab, unbound_durat;
+    EXPECT_EQ(marks, GenuinePositions(unbound, minutes(60), fxprofit_short, 0.0005, unbound_adjust, unbound_probab,
+                                      unbound_durat));
+    EXPECT_EQ(adjust, unbound_adjust);
+    EXPECT_EQ(adjust, GenuinePositions(MakeSeries(unbound), minutes(60), fxprofit_mean_short, {0.0005}).front().adjust);
+    EXPECT_TRUE(GenuinePositions(ser, minutes(60), fxprofit_mean_long, std::vector<double>()).empty());
+    EXPECT_THROW(GenuinePositions(ser, minutes(60), fxprofit_mean_long, std::vector<double>{0.001, 0.0005}),
+                 std::invalid_argument);
+}
+
+TEST_F(fxanalysis_test_fixture, genuine_positions_parallel) {
+    // Enough candles to be split into partitions for several jobs.
+    const fxseries ser = MakeSeries(make_walk(120));
+    const std::vector<double> margins = {0.0, 0.0005, 0.002};
+    for (const int timeout : {1, 240, 10080}) {
+        const auto serial = GenuinePositions(ser, minutes(timeout), fxprofit_mean_long, margins, 1);
+        for (const unsigned jobs : {2u, 4u, 7u}) {
+            const auto parallel = GenuinePositions(ser, minutes(timeout), fxprofit_mean_long, margins, jobs);
+            ASSERT_EQ(serial.size(), parallel.size());
+            for (size_t k = 0; k < serial.size(); k++) {
+                EXPECT_EQ(serial[k].marks, parallel[k].marks) << "timeout " << timeout << ", jobs " << jobs;
+                EXPECT_EQ(serial[k].adjust, parallel[k].adjust);
+                EXPECT_EQ(serial[k].probab, parallel[k].probab);
+                EXPECT_EQ(serial[k].durat, parallel[k].durat);
+            }
+        }
+    }
+}
+
+TEST_F(fxanalysis_test_fixture, sliding_extremes) {
+    const fxseries ser = MakeSeries(make_walk());
+    for (const int timeout : {1, 7, 240}) {
+        fxsliding_extremes extremes(ser, minutes(timeout));
+        // Candles are opened by steps of 1 and 3, so the window is moved over skipped candles as well.
+        for (size_t iopen = 0; iopen < ser.size(); iopen += (iopen % 2 == 0 ? 1 : 3)) {
+            size_t imax = ser.size();
+            size_t imin = ser.size();
+            for (size_t i = iopen + 1; i < ser.size() && ser.minute[i] - ser.minute[iopen] <= timeout; i++) {
+                if (imax == ser.size() || ser.mean[imax] < ser.mean[i]) {
+                    imax = i;
+                }
+                if (imin == ser.size() || ser.mean[imin] > ser.mean[i]) {
+                    imin = i;
+                }
+            }
+            ASSERT_EQ(imax != ser.size(), extremes.open(iopen)) << "timeout " << timeout << ", open " << iopen;
+            if (imax != ser.size()) {
+                EXPECT_EQ(imax, extremes.max_index());
+                EXPECT_EQ(imin, extremes.min_index());
+            }
+        }
+    }
+}
+
+}  // namespace fxlib
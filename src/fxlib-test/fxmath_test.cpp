@@ -0,0 +1,168 @@
+#include "fxlib/fxmath.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace fxlib {
+
+class fxmath_test_fixture : public ::testing::Test {
+ protected:
+    // Margins of pseudo-random samples are rounded to 1e-5, so many samples share margins, periods are whole minutes.
+    static fxmargin_samples make_samples(size_t count) {
+        fxmargin_samples samples;
+        uint32_t state = 54321;
+        for (size_t i = 0; i < count; i++) {
+            state = state * 1103515245 + 12345;
+            samples.push_back(
+                {static_cast<double>((state >> 8) % 1200) * 1e-5, static_cast<double>((state >> 4) % 900)});
+        }
+        return samples;
+    }
+};
+
+TEST_F(fxmath_test_fixture, running_stats) {
+    const fxmargin_samples samples = make_samples(5000);
+    double mean;
+    double variance;
+    MarginStats(samples, mean, variance);
+    fxrunning_stats stats;
+    fxrunning_stats head;
+    fxrunning_stats tail;
+    for (size_t i = 0; i < samples.size(); i++) {
+        stats.add(samples[i].margin);
+        (i < 1234 ? head : tail).add(samples[i].margin);
+    }
+    head.merge(tail);
+    for (const auto& s : {stats, head}) {
+        EXPECT_EQ(samples.size(), s.count());
+        EXPECT_NEAR(mean, s.mean(), 1e-12);
+        EXPECT_NEAR(variance, s.variance(), 1e-12);
+    }
+    EXPECT_EQ(0, fxrunning_stats().variance());
+}
+
+TEST_F(fxmath_test_fixture, margin_histogram) {
+    fxmargin_samples samples = make_samples(5000);
+    const size_t distr_size = 40;
+    const double from = 0.001;
+    const double step = 0.0002;
+    fxmargin_histogram hist(distr_size, from, step);
+    fxmargin_histogram head(distr_size, from, step);
+    fxmargin_histogram tail(distr_size, from, step);
+    for (size_t i = 0; i < samples.size(); i++) {
+        hist.add(samples[i]);
+        (i < 777 ? head : tail).add(samples[i]);
+    }
+    head.merge(tail);
+    fxsort(samples);
+    const auto distrib = MarginDistribution(samples, distr_size, from, step);
+    const auto probab = MarginProbability(samples, distr_size, from, step);
+    const auto durats = MarginDurationDistribution(samples, distr_size, from, step);
+    for (const auto& h : {hist, head}) {
+        EXPECT_EQ(samples.size(), h.size());
+        const fxmargin_distributions distribs = h.distributions();
+        ASSERT_EQ(distrib.size(), distribs.distrib.size());
+        ASSERT_EQ(probab.size(), distribs.probab.size());
+        ASSERT_EQ(durats.size(), distribs.durats.size());
+        for (size_t i = 0; i < distrib.size(); i++) {
+            EXPECT_EQ(distrib[i].bound, distribs.distrib[i].bound);
+            EXPECT_EQ(distrib[i].count, distribs.distrib[i].count) << "bin " << i;
+            EXPECT_EQ(probab[i].bound, distribs.probab[i].bound);
+            EXPECT_EQ(probab[i].count, distribs.probab[i].count) << "bin " << i;
+            EXPECT_EQ(probab[i].prob, distribs.probab[i].prob);
+            EXPECT_EQ(durats[i].bound, distribs.durats[i].bound);
+            EXPECT_EQ(durats[i].count, distribs.durats[i].count) << "bin " << i;
+            EXPECT_NEAR(durats[i].durat, distribs.durats[i].durat, 1e-9);
+            EXPECT_NEAR(durats[i].error, distribs.durats[i].error, 1e-9);
+        }
+    }
+    EXPECT_THROW(hist.merge(fxmargin_histogram(distr_size, from, 2 * step)), std::logic_error);
+}
+
+TEST_F(fxmath_test_fixture, margin_distributions) {
+    fxmargin_samples samples = make_samples(5000);
+    fxsort(samples);
+    for (const double from : {0.0, 0.001, 0.02}) {
+        const size_t distr_size = 30;
+        const double step = 0.0003;
+        const auto distrib = MarginDistribution(samples, distr_size, from, step);
+        const auto probab = MarginProbability(samples, distr_size, from, step);
+        const auto durats = MarginDurationDistribution(samples, distr_size, from, step);
+        const fxmargin_distributions distribs = MarginDistributions(samples, distr_size, from, step);
+        ASSERT_EQ(distrib.size(), distribs.distrib.size());
+        ASSERT_EQ(probab.size(), distribs.probab.size());
+        ASSERT_EQ(durats.size(), distribs.durats.size());
+        for (size_t i = 0; i < distrib.size(); i++) {
+            EXPECT_EQ(distrib[i].bound, distribs.distrib[i].bound);
+            EXPECT_EQ(distrib[i].count, distribs.distrib[i].count) << "from " << from << ", bin " << i;
+            EXPECT_EQ(probab[i].bound, distribs.probab[i].bound);
+            EXPECT_EQ(probab[i].count, distribs.probab[i].count) << "from " << from << ", bin " << i;
+            EXPECT_EQ(probab[i].prob, distribs.probab[i].prob);
+            EXPECT_EQ(durats[i].bound, distribs.durats[i].bound);
+            EXPECT_EQ(durats[i].count, distribs.durats[i].count) << "from " << from << ", bin " << i;
+            EXPECT_NEAR(durats[i].durat, distribs.durats[i].durat, 1e-9);
+            EXPECT_NEAR(durats[i].error, distribs.durats[i].error, 1e-9);
+        }
+    }
+}
+
+TEST_F(fxmath_test_fixture, fxsort) {
+    for (const size_t count : {size_t(0), size_t(1), size_t(100), size_t(5000), size_t(300000)}) {
+        fxmargin_samples samples = make_samples(count);
+        // Negative margins, signed zeros and the number of the sample as its period to check the stability.
+        for (size_t i = 0; i < samples.size(); i++) {
+            samples[i].margin -= 0.006;
+            if (i % 97 == 0) {
+                samples[i].margin = i % 2 == 0 ? 0.0 : -0.0;
+            }
+            samples[i].period = static_cast<double>(i);
+        }
+        fxmargin_samples expected = samples;
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const fxmargin_sample& lhs, const fxmargin_sample& rhs) { return lhs.margin < rhs.margin; });
+        for (const unsigned jobs : {1u, 3u, 8u}) {
+            fxmargin_samples sorted = samples;
+            fxsort(sorted, jobs);
+            ASSERT_EQ(expected.size(), sorted.size());
+            for (size_t i = 0; i < expected.size(); i++) {
+                ASSERT_EQ(expected[i].margin, sorted[i].margin) << "count " << count << ", jobs " << jobs;
+                ASSERT_EQ(expected[i].period, sorted[i].period) << "count " << count << ", jobs " << jobs;
+            }
+        }
+    }
+}
+
+// Compares std::sort by the margin that fxsort has used before with the radix sort on one and on all the threads.
+// Disabled by default, run by --gtest_also_run_disabled_tests.
+TEST_F(fxmath_test_fixture, DISABLED_fxsort_benchmark) {
+    using clock = std::chrono::steady_clock;
+    const fxmargin_samples samples = make_samples(size_t(1) << 22);
+    fxmargin_samples std_sorted = samples;
+    fxmargin_samples radix_sorted = samples;
+    fxmargin_samples parallel_sorted = samples;
+    const auto t0 = clock::now();
+    std::sort(std_sorted.begin(), std_sorted.end(),
+              [](const fxmargin_sample& lhs, const fxmargin_sample& rhs) { return lhs.margin < rhs.margin; });
+    const auto t1 = clock::now();
+    fxsort(radix_sorted, 1);
+    const auto t2 = clock::now();
+    fxsort(parallel_sorted, 0);
+    const auto t3 = clock::now();
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        ASSERT_EQ(std_sorted[i].margin, radix_sorted[i].margin);
+        ASSERT_EQ(std_sorted[i].margin, parallel_sorted[i].margin);
+    }
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Samples: " << samples.size() << std::endl;
+    std::cout << "Sort: std::sort " << ms(t1 - t0).count() << " ms, radix " << ms(t2 - t1).count() << " ms, radix ("
+              << std::thread::hardware_concurrency() << " threads) " << ms(t3 - t2).count() << " ms" << std::endl;
+}
+
+}  // namespace fxlib
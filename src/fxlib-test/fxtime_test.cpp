@@ -1,19 +1,28 @@
-
+#include "fxlib/fxtime.h"
 #include "fxlib/helpers/fxtime_conversion.h"
 #include "fxlib/helpers/fxtime_serializable.h"
+#include "fxlib/helpers/string_conversion.h"
 
 #include <gtest/gtest.h>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
 
+#include <chrono>
+#include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 namespace fxlib {
+using conversion::from_epoch_minutes;
 using conversion::from_iso_string;
+using conversion::from_ptime;
+using conversion::to_epoch_minutes;
 using conversion::to_iso_string;
+using conversion::to_ptime;
 using conversion::try_from_iso_string;
 using conversion::try_to_iso_string;
 using std::string;
@@ -205,4 +214,235 @@ TEST_F(fxtime_test_fixture, fxtime_serialization) {
     }
 }
 
+TEST_F(fxtime_test_fixture, fxtime_codec_ptime) {
+    EXPECT_EQ(correct_ptime, to_ptime(correct_fxtime));
+    EXPECT_EQ(correct_fxtime.data, from_ptime(correct_ptime).data);
+    EXPECT_THROW(to_ptime(invalid_fxtime), std::bad_cast);
+    EXPECT_THROW(to_ptime(bad_separator_time), std::bad_cast);
+    EXPECT_THROW(to_ptime(bad_highdig_time), std::bad_cast);
+    EXPECT_THROW(to_ptime(bad_lowdig_time), std::bad_cast);
+    EXPECT_THROW(from_ptime(invalid_ptime), std::bad_cast);
+    boost::posix_time::ptime time;
+    EXPECT_FALSE(conversion::try_to_ptime(invalid_fxtime, time));
+    fxtime t;
+    EXPECT_FALSE(conversion::try_from_ptime(invalid_ptime, t));
+    // Leap day and the end of a day must survive the round trip.
+    const boost::posix_time::ptime leap = {{2016, boost::date_time::Feb, 29}, {23, 59, 59}};
+    EXPECT_EQ(leap, to_ptime(from_ptime(leap)));
+    const fxtime feb30 = {{0x20, 0x15, 0x02, 0x30, 0xDD, 0x00, 0x00, 0x00}};
+    EXPECT_THROW(to_ptime(feb30), std::bad_cast);
+}
+
+TEST_F(fxtime_test_fixture, fxtime_codec_epoch_minutes) {
+    const boost::posix_time::ptime epoch(boost::gregorian::date(1970, boost::date_time::Jan, 1));
+    const int64_t correct_mins = (correct_ptime - epoch).total_seconds() / 60;
+    EXPECT_EQ(correct_mins, to_epoch_minutes(correct_fxtime));
+    // Seconds are truncated.
+    EXPECT_EQ(to_ptime(from_epoch_minutes(correct_mins)), correct_ptime - boost::posix_time::seconds(31));
+    EXPECT_EQ(0, to_epoch_minutes(from_ptime(epoch)));
+    EXPECT_EQ(-1, to_epoch_minutes(from_ptime(epoch - boost::posix_time::minutes(1))));
+    EXPECT_THROW(to_epoch_minutes(invalid_fxtime), std::bad_cast);
+    for (int64_t mins = correct_mins - 3 * 366 * 1440; mins < correct_mins; mins += 997) {
+        const fxtime t = from_epoch_minutes(mins);
+        EXPECT_EQ(mins, to_epoch_minutes(t));
+        EXPECT_EQ(epoch + boost::posix_time::minutes(mins), to_ptime(t));
+    }
+}
+
+// Compares the string round trip with the direct codec on the quote times of quote-bases.
+// Disabled by default, run by --gtest_also_run_disabled_tests.
+TEST_F(fxtime_test_fixture, DISABLED_fxtime_codec_benchmark) {
+    namespace fs = boost::filesystem;
+    using clock = std::chrono::steady_clock;
+    const fs::path bases = fs::path(__FILE__).parent_path() / ".." / ".." / "quote-bases";
+    ASSERT_TRUE(fs::is_directory(bases)) << bases << " not found";
+    std::vector<boost::posix_time::ptime> times;
+    for (const auto& entry : fs::directory_iterator(bases)) {
+        std::ifstream fin(entry.path().string());
+        std::string line;
+        std::getline(fin, line);  // header
+        std::string ticker, per, date, time;
+        while (fin >> ticker >> per >> date >> time && std::getline(fin, line)) {
+            times.push_back(boost::posix_time::from_iso_string("20" + date + "T" + time + "00"));
+        }
+    }
+    ASSERT_FALSE(times.empty());
+
+    std::vector<fxtime> str_bins(times.size());
+    std::vector<fxtime> bins(times.size());
+    std::vector<boost::posix_time::ptime> str_times(times.size());
+    std::vector<boost::posix_time::ptime> codec_times(times.size());
+    const auto t0 = clock::now();
+    for (size_t i = 0; i < times.size(); i++) {
+        str_bins[i] = from_iso_string(boost::posix_time::to_iso_string(times[i]));
+    }
+    const auto t1 = clock::now();
+    for (size_t i = 0; i < times.size(); i++) {
+        bins[i] = from_ptime(times[i]);
+    }
+    const auto t2 = clock::now();
+    for (size_t i = 0; i < times.size(); i++) {
+        str_times[i] = boost::posix_time::from_iso_string(to_iso_string(bins[i]));
+    }
+    const auto t3 = clock::now();
+    for (size_t i = 0; i < times.size(); i++) {
+        codec_times[i] = to_ptime(bins[i]);
+    }
+    const auto t4 = clock::now();
+
+    for (size_t i = 0; i < times.size(); i++) {
+        ASSERT_EQ(str_bins[i].data, bins[i].data);
+        ASSERT_EQ(times[i], str_times[i]);
+        ASSERT_EQ(times[i], codec_times[i]);
+    }
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Times: " << times.size() << std::endl;
+    std::cout << "Encode: strings " << ms(t1 - t0).count() << " ms, codec " << ms(t2 - t1).count() << " ms"
+              << std::endl;
+    std::cout << "Decode: strings " << ms(t3 - t2).count() << " ms, codec " << ms(t4 - t3).count() << " ms"
+              << std::endl;
+}
+
+TEST_F(fxtime_test_fixture, epoch_minutes) {
+    using namespace boost::gregorian;
+    using namespace boost::posix_time;
+    EXPECT_EQ(0, ToEpochMinutes(ptime(date(1970, Jan, 1))));
+    EXPECT_EQ(-1, ToEpochMinutes(ptime(date(1969, Dec, 31), time_duration(23, 59, 30))));
+    EXPECT_EQ(16440 * 1440 + 630, ToEpochMinutes(ptime(date(2015, Jan, 5), time_duration(10, 30, 59))));
+    for (ptime t(date(2015, Mar, 28), hours(23)); t < ptime(date(2015, Mar, 30)); t += minutes(7)) {
+        EXPECT_EQ(conversion::to_epoch_minutes(from_ptime(t)), ToEpochMinutes(t));
+        EXPECT_EQ(t, FromEpochMinutes(ToEpochMinutes(t)));
+    }
+    EXPECT_EQ(120, ToMinutes(hours(2)));
+    EXPECT_THROW(ToEpochMinutes(ptime()), std::logic_error);
+}
+
+TEST_F(fxtime_test_fixture, fxbuckets) {
+    using namespace boost::gregorian;
+    using namespace boost::posix_time;
+    const fxbuckets quarters(minutes(15));
+    EXPECT_EQ(minutes(15), quarters.period());
+    const int64_t idx = quarters.index(ptime(date(2015, Jan, 5), time_duration(10, 1, 0)));
+    EXPECT_EQ(idx, quarters.index(ptime(date(2015, Jan, 5), time_duration(10, 15, 0))));
+    EXPECT_EQ(idx + 1, quarters.index(ptime(date(2015, Jan, 5), time_duration(10, 15, 15))));
+    EXPECT_EQ(idx + 1, quarters.index(ToEpochMinutes(ptime(date(2015, Jan, 5), time_duration(10, 16, 0)))));
+    EXPECT_EQ(ptime(date(2015, Jan, 5), time_duration(10, 15, 0)), quarters.end_time(idx));
+    // A weekend gap is skipped at once.
+    EXPECT_EQ(idx + 4 * (24 * 7 - 3), quarters.index(ptime(date(2015, Jan, 12), time_duration(7, 15, 0))));
+    // The 00:00 candle closes the day.
+    const fxbuckets days(hours(24));
+    EXPECT_EQ(ptime(date(2015, Jan, 6)), days.end_time(days.index(ptime(date(2015, Jan, 6)))));
+    EXPECT_EQ(ptime(date(2015, Jan, 7)), days.end_time(days.index(ptime(date(2015, Jan, 6), minutes(1)))));
+    // The trading week from Sunday till Saturday is one bucket.
+    const fxbuckets weeks(hours(24 * 7));
+    const ptime sunday(date(2015, Jan, 4), time_duration(21, 1, 0));
+    EXPECT_EQ(weeks.index(sunday), weeks.index(ptime(date(2015, Jan, 10), hours(3))));
+    EXPECT_EQ(ptime(date(2015, Jan, 11)), weeks.end_time(weeks.index(sunday)));
+    // Days closed at 21:00 GMT.
+    const fxbuckets sessions(hours(24), ptime(date(2015, Jan, 1), hours(21)));
+    EXPECT_EQ(ptime(date(2015, Jan, 5), hours(21)), sessions.end_time(sessions.index(sunday)));
+    EXPECT_EQ(ptime(date(2015, Jan, 4), hours(21)),
+              sessions.end_time(sessions.index(ptime(date(2015, Jan, 4), hours(21)))));
+    // Times before the anchor.
+    const fxbuckets hourly(hours(1));
+    EXPECT_EQ(ptime(date(1969, Dec, 31), hours(23)),
+              hourly.end_time(hourly.index(ptime(date(1969, Dec, 31), minutes(22 * 60 + 1)))));
+    EXPECT_THROW(fxbuckets(seconds(90)), std::logic_error);
+    EXPECT_THROW(fxbuckets(minutes(0)), std::logic_error);
+    EXPECT_THROW(fxbuckets(hours(1), ptime(date(2015, Jan, 1), seconds(30))), std::logic_error);
+}
+
+TEST_F(fxtime_test_fixture, fxcalendar) {
+    using namespace boost::gregorian;
+    using namespace boost::posix_time;
+    const date_period period(date(2017, Sep, 7), days(23));
+    const fxcalendar calendar(period);
+    EXPECT_EQ(period, calendar.period());
+    // Open candle times are counted one by one.
+    std::vector<ptime> times;
+    std::vector<long> counts;
+    long count = 0;
+    for (ptime t = ptime(period.begin()) + minutes(1); t <= ptime(period.end()); t += minutes(1)) {
+        const bool open = ForexOpenHours((t - minutes(1)).date()).contains(t);
+        EXPECT_EQ(open, calendar.is_open(t)) << t;
+        count += open ? 1 : 0;
+        times.push_back(t);
+        counts.push_back(count);
+    }
+    for (size_t i = 0; i < times.size(); i += 7) {
+        EXPECT_EQ(minutes(counts[i]), calendar.open_time(ptime(period.begin()), times[i])) << times[i];
+        for (size_t j = i; j < times.size(); j += 997) {
+            EXPECT_EQ(minutes(counts[j] - counts[i]), calendar.open_time(times[i], times[j]));
+        }
+    }
+    EXPECT_EQ(minutes(count), calendar.open_time(period));
+    time_duration week;
+    for (day_iterator ditr = {date(2017, Sep, 10)}; ditr < date(2017, Sep, 17); ++ditr) {
+        week += ForexOpenHours(*ditr).length();
+    }
+    EXPECT_EQ(week, calendar.open_time(date_period(date(2017, Sep, 10), days(7))));
+    EXPECT_THROW(calendar.is_open(ptime(period.end()) + minutes(1)), std::out_of_range);
+    EXPECT_THROW(calendar.open_time(ptime(period.begin()) - minutes(1), ptime(period.end())), std::out_of_range);
+}
+
+TEST_F(fxtime_test_fixture, fxsession_map) {
+    using namespace boost::gregorian;
+    using namespace boost::posix_time;
+    // DST of New York, London and Sydney is changed within the period.
+    const date_period period(date(2015, Mar, 1), date(2015, Apr, 10));
+    const fxsession_map sessions(period);
+    EXPECT_EQ(period, sessions.period());
+    for (ptime t = ptime(period.begin()) + minutes(1); t <= ptime(period.end()); t += minutes(1)) {
+        ASSERT_EQ(ForexSessions(t), sessions.mask(t)) << t;
+    }
+    // London by GMT and BST.
+    EXPECT_FALSE(sessions.is_open(ptime(date(2015, Mar, 27), hours(8)), fxlondon));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 27), hours(8) + minutes(1)), fxlondon));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 27), hours(16)), fxlondon));
+    EXPECT_FALSE(sessions.is_open(ptime(date(2015, Mar, 27), hours(16) + minutes(1)), fxlondon));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 30), hours(7) + minutes(1)), fxlondon));
+    EXPECT_FALSE(sessions.is_open(ptime(date(2015, Mar, 30), hours(15) + minutes(1)), fxlondon));
+    // New York by EST and EDT.
+    EXPECT_FALSE(sessions.is_open(ptime(date(2015, Mar, 6), hours(13)), fxnewyork));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 6), hours(13) + minutes(1)), fxnewyork));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 9), hours(12) + minutes(1)), fxnewyork));
+    // Tokyo opens on Monday at Sunday night of GMT.
+    EXPECT_EQ(fxtokyo, sessions.mask(ptime(date(2015, Mar, 8), hours(23) + minutes(1))) & fxtokyo);
+    EXPECT_EQ(0, sessions.mask(ptime(date(2015, Mar, 8), hours(22) + minutes(1))) & fxtokyo);
+    // Sydney by AEDT and AEST.
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Mar, 30), hours(21) + minutes(1)), fxsydney));
+    EXPECT_FALSE(sessions.is_open(ptime(date(2015, Apr, 6), hours(21) + minutes(1)), fxsydney));
+    EXPECT_TRUE(sessions.is_open(ptime(date(2015, Apr, 6), hours(22) + minutes(1)), fxsydney));
+    // No session on Saturday.
+    EXPECT_EQ(0, sessions.mask(ptime(date(2015, Mar, 7), hours(12))));
+    EXPECT_THROW(sessions.mask(ptime(period.begin())), std::out_of_range);
+    EXPECT_THROW(sessions.mask(ptime(period.end()) + minutes(1)), std::out_of_range);
+
+    // Former DST rules: New York by EST till the first Sunday of April 2005, Sydney by AEDT till the first Sunday of
+    // April 2006 and by AEST till the last Sunday of October 2007.
+    const fxsession_map former(date_period(date(2005, Mar, 1), date(2007, Nov, 1)));
+    EXPECT_FALSE(former.is_open(ptime(date(2005, Mar, 21), hours(12) + minutes(1)), fxnewyork));
+    EXPECT_TRUE(former.is_open(ptime(date(2005, Mar, 21), hours(13) + minutes(1)), fxnewyork));
+    EXPECT_TRUE(former.is_open(ptime(date(2005, Apr, 4), hours(12) + minutes(1)), fxnewyork));
+    EXPECT_TRUE(former.is_open(ptime(date(2006, Mar, 26), hours(21) + minutes(1)), fxsydney));
+    EXPECT_FALSE(former.is_open(ptime(date(2006, Apr, 2), hours(21) + minutes(1)), fxsydney));
+    EXPECT_FALSE(former.is_open(ptime(date(2007, Oct, 7), hours(21) + minutes(1)), fxsydney));
+    EXPECT_TRUE(former.is_open(ptime(date(2007, Oct, 7), hours(22) + minutes(1)), fxsydney));
+    EXPECT_TRUE(former.is_open(ptime(date(2007, Oct, 28), hours(21) + minutes(1)), fxsydney));
+
+    // Without sessions every candle is accepted, out of session hours and on Saturday too.
+    const fxsession_filter all(period, boost::none);
+    const fxsession_filter london(period, fxsession_mask(fxlondon));
+    for (ptime t = ptime(period.begin()) + minutes(1); t <= ptime(period.end()); t += minutes(1)) {
+        ASSERT_TRUE(all.accepts(t)) << t;
+        ASSERT_EQ(sessions.is_open(t, fxlondon), london.accepts(ToEpochMinutes(t))) << t;
+    }
+    EXPECT_EQ(0, sessions.mask(ptime(date(2015, Mar, 6), hours(21) + minutes(31))));
+    EXPECT_TRUE(all.accepts(ptime(date(2015, Mar, 6), hours(21) + minutes(31))));
+
+    EXPECT_EQ(fxlondon | fxnewyork, conversion::sessions_from_string("London, newyork"));
+    EXPECT_EQ(fxall_sessions, conversion::sessions_from_string("all"));
+    EXPECT_THROW(conversion::sessions_from_string("paris"), std::invalid_argument);
+}
+
 }  // namespace fxlib
@@ -2,11 +2,209 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 
 namespace fxlib {
 
-fxcandle MakeFromFinam(const std::string& line, const std::string& pair_name) noexcept(false) {
+namespace {
+// Fields of a line in order of Finam export.
+enum finam_field {
+    ticker_field,
+    per_field,
+    date_field,
+    time_field,
+    open_field,
+    high_field,
+    low_field,
+    close_field,
+    vol_field,
+    finam_fields
+};
+
+// The same set of characters as '\s' of the regular expression.
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool all_digits(boost::string_view s) {
+    for (const char c : s) {
+        if (!is_digit(c)) {
+            return false;
+        }
+    }
+    return !s.empty();
+}
+
+// [0-9]+\.[0-9]*
+bool is_price(boost::string_view s) {
+    const size_t dot = s.find('.');
+    return dot != boost::string_view::npos && all_digits(s.substr(0, dot)) &&
+           (dot + 1 == s.size() || all_digits(s.substr(dot + 1)));
+}
+
+// Splitting by whitespaces with checking of every field, it accepts the same lines as rxFinamExportFormat.
+bool split_finam(boost::string_view line, boost::string_view (&fields)[finam_fields]) {
+    size_t pos = 0;
+    for (int f = 0; f < finam_fields; f++) {
+        if (f > 0) {
+            const size_t sep = pos;
+            while (pos < line.size() && is_space(line[pos])) {
+                pos++;
+            }
+            if (pos == sep) {
+                return false;
+            }
+        }
+        const size_t start = pos;
+        while (pos < line.size() && !is_space(line[pos])) {
+            pos++;
+        }
+        fields[f] = line.substr(start, pos - start);
+    }
+    if (pos != line.size()) {
+        return false;
+    }
+    for (const char c : fields[ticker_field]) {
+        if (c < 'A' || c > 'Z') {
+            return false;
+        }
+    }
+    return fields[ticker_field].size() == 6 && all_digits(fields[per_field]) && fields[date_field].size() == 6 &&
+           all_digits(fields[date_field]) && fields[time_field].size() == 4 && all_digits(fields[time_field]) &&
+           is_price(fields[open_field]) && is_price(fields[high_field]) && is_price(fields[low_field]) &&
+           is_price(fields[close_field]) && all_digits(fields[vol_field]);
+}
+
+template <typename T>
+bool parse_unsigned(boost::string_view s, T& value) {
+    T v = 0;
+    for (const char c : s) {
+        const T d = static_cast<T>(c - '0');
+        if (v > (std::numeric_limits<T>::max() - d) / 10) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    value = v;
+    return true;
+}
+
+int two_digits(const char* s) {
+    return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+// A price with up to 15 significant digits and 22 decimals is exact as the quotient of two exactly represented
+// numbers, other prices are left to strtod.
+bool parse_price(boost::string_view s, double& price) {
+    static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    while (s.size() > 1 && s.back() == '0' && s.find('.') != boost::string_view::npos) {
+        s.remove_suffix(1);
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = -1;
+    for (const char c : s) {
+        if (c == '.') {
+            decimals = 0;
+            continue;
+        }
+        if (mantissa != 0 || c != '0') {
+            digits++;
+        }
+        mantissa = mantissa * 10 + static_cast<uint64_t>(c - '0');
+        if (decimals >= 0) {
+            decimals++;
+        }
+        if (digits > 15) {
+            break;
+        }
+    }
+    if (digits <= 15 && decimals <= 22) {
+        price = static_cast<double>(mantissa) / pow10[decimals < 0 ? 0 : decimals];
+        return true;
+    }
+    char buf[64];
+    if (s.size() < sizeof(buf)) {
+        std::memcpy(buf, s.data(), s.size());
+        buf[s.size()] = '\0';
+        price = std::strtod(buf, nullptr);
+    } else {
+        price = std::strtod(s.to_string().c_str(), nullptr);
+    }
+    return true;
+}
+}  // namespace
+
+fxcandle MakeFromFinam(boost::string_view line, boost::string_view pair_name) noexcept(false) {
+    fxcandle candle{};
+    // Split line
+    boost::string_view what[finam_fields];
+    if (!split_finam(line, what)) {
+        throw std::logic_error("The line is not matched Finam export format.");
+    }
+    // Check and cast line partions
+    bool same_ticker = what[ticker_field].size() == pair_name.size();
+    for (size_t i = 0; same_ticker && i < pair_name.size(); i++) {
+        same_ticker = what[ticker_field][i] == std::toupper(static_cast<unsigned char>(pair_name[i]));
+    }
+    if (!same_ticker) {
+        throw std::logic_error("Found ticker " + what[ticker_field].to_string() + " in lieu of " +
+                               pair_name.to_string());
+    }
+    int period;  // It assumes that only minutely quote is required.
+    if (!parse_unsigned(what[per_field], period) || period != 1) {
+        throw std::logic_error("Found period " + what[per_field].to_string() + " in lieu of 1");
+    }
+    try {
+        const char* d = what[date_field].data();
+        const char* t = what[time_field].data();
+        candle.time = boost::posix_time::ptime(
+            boost::gregorian::date(2000 + two_digits(d), two_digits(d + 2), two_digits(d + 4)),
+            boost::posix_time::time_duration(two_digits(t), two_digits(t + 2), 0));
+    } catch (const std::exception& e) {
+        throw std::logic_error("Found wrong date-time " + what[date_field].to_string() + " " +
+                               what[time_field].to_string() + ": " + e.what());
+    }
+    if (candle.time.is_not_a_date_time()) {
+        throw std::logic_error("Found wrong date-time " + what[date_field].to_string() + " " +
+                               what[time_field].to_string());
+    }
+    if (!parse_price(what[open_field], candle.open)) {
+        throw std::logic_error("Found wrong OPEN quotation " + what[open_field].to_string());
+    }
+    if (!parse_price(what[close_field], candle.close)) {
+        throw std::logic_error("Found wrong CLOSE quotation " + what[close_field].to_string());
+    }
+    if (!parse_price(what[high_field], candle.high)) {
+        throw std::logic_error("Found wrong HIGH quotation " + what[high_field].to_string());
+    }
+    if (!parse_price(what[low_field], candle.low)) {
+        throw std::logic_error("Found wrong LOW quotation " + what[low_field].to_string());
+    }
+    if (!parse_unsigned(what[vol_field], candle.volume)) {
+        throw std::logic_error("Found wrong volume field " + what[vol_field].to_string());
+    }
+    return candle;
+}
+
+namespace detail {
+
+const boost::regex rxFinamExportFormat(
+    "^(?'TICKER'[A-Z]{6})\\s+(?'PER'[0-9]+)\\s+(?'DATE'[0-9]{6})\\s+(?'TIME'[0-9]{4})\\s+"
+    "(?'OPEN'[0-9]+\\.[0-9]*)\\s+(?'HIGH'[0-9]+\\.[0-9]*)\\s+"
+    "(?'LOW'[0-9]+\\.[0-9]*)\\s+(?'CLOSE'[0-9]+\\.[0-9]*)\\s+(?'VOL'[0-9]+)$");
+
+fxcandle make_from_finam_regex(const std::string& line, const std::string& pair_name) noexcept(false) {
     fxcandle candle{};
     // Split line
     boost::smatch what;
@@ -46,13 +244,5 @@ fxcandle MakeFromFinam(const std::string& line, const std::string& pair_name) no
     }
     return candle;
 }
-
-namespace detail {
-
-const boost::regex rxFinamExportFormat(
-    "^(?'TICKER'[A-Z]{6})\\s+(?'PER'[0-9]+)\\s+(?'DATE'[0-9]{6})\\s+(?'TIME'[0-9]{4})\\s+"
-    "(?'OPEN'[0-9]+\\.[0-9]*)\\s+(?'HIGH'[0-9]+\\.[0-9]*)\\s+"
-    "(?'LOW'[0-9]+\\.[0-9]*)\\s+(?'CLOSE'[0-9]+\\.[0-9]*)\\s+(?'VOL'[0-9]+)$");
-}
-// namespace fxlib
+}  // namespace detail
 }  // namespace fxlib
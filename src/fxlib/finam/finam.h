@@ -3,17 +3,22 @@
 #include "fxlib/fxquote.h"
 
 #include <boost/regex.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include <string>
 
 namespace fxlib {
 
-fxcandle MakeFromFinam(const std::string& line, const std::string& pair_name) noexcept(false);
+// Parsing a line of Finam export in a single pass without allocations (except for errors).
+fxcandle MakeFromFinam(boost::string_view line, boost::string_view pair_name) noexcept(false);
 
 namespace detail {
 
 // Finam is a Russian website that allows you to get at least two months worth of one-minute Forex data.
 extern const boost::regex rxFinamExportFormat;
 
+// Parsing by the regular expression that is the reference of MakeFromFinam, the results and errors are the same.
+fxcandle make_from_finam_regex(const std::string& line, const std::string& pair_name) noexcept(false);
+
 }  // namespace detail
 }  // namespace fxlib
@@ -1,10 +1,268 @@
 #include "fxanalysis.h"
+#include "fxtime.h"
 #include "math/mathlib/nonlsyseq.h"
 
 #include <boost/optional.hpp>
 
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
 namespace fxlib {
 
+namespace {
+// Open candidates waiting for their first closes with the expected margins, candles are pushed in time order.
+/*
+  A pushed candle is tried as the close of the waiting candidates and then it waits itself. The profit depends on the
+  open by its mean monotonically, so the candidates that reach a margin are at an end of the ones waiting for it
+  ordered by mean. Thus every candle costs O(log W) for W candles within the timeout instead of a scan of the timeout
+  for every candidate. The first close with a wider margin is never earlier, so a candidate waits only for the
+  narrowest margin that it has not reached, the margins should be sorted.
+  Candidates are done in time order as soon as their closes are known and the timeout after them is covered by pushed
+  candles, the rest are done by finish() when the timeout after them is covered by the last candle.
+*/
+template <typename Rate, typename Profit>
+class first_passage {
+ public:
+    struct candidate {
+        fxminutes time;
+        Rate rate;
+        size_t level;  // the narrowest margin that has not been reached
+        bool waiting;
+        typename std::set<std::pair<double, size_t>>::iterator order;
+    };
+    // Durations to the first closes with the margins, negative when there is none.
+    using durations_iterator = std::deque<fxminutes>::const_iterator;
+
+    first_passage(fxminutes span, Profit profit, const std::vector<double>& margins)
+        : span_(span),
+          profit_(profit),
+          margins_(margins),
+          first_(0),
+          expired_(0),
+          last_time_(0),
+          waiting_(margins.size()) {}
+
+    template <typename Done>
+    void push(fxminutes time, const Rate& rate, double mean, Done done) {
+        // Candidates out of the timeout cannot be closed any more.
+        for (; expired_ < candidates_.size() && time - candidates_[expired_].time > span_; ++expired_) {
+            stop_waiting(candidates_[expired_]);
+        }
+        for (size_t level = 0; level < margins_.size(); level++) {
+            auto& waiting = waiting_[level];
+            while (!waiting.empty()) {
+                auto it = waiting.begin();
+                double profit = profit_(rate, at(it->second).rate);
+                if (profit < margins_[level]) {
+                    it = std::prev(waiting.end());
+                    profit = profit_(rate, at(it->second).rate);
+                    if (profit < margins_[level]) {
+                        break;
+                    }
+                }
+                const double open_mean = it->first;
+                const size_t id = it->second;
+                candidate& open = at(id);
+                stop_waiting(open);
+                // The close may reach wider margins as well.
+                for (; open.level < margins_.size() && profit >= margins_[open.level]; ++open.level) {
+                    durations_[(id - first_) * margins_.size() + open.level] = time - open.time;
+                }
+                if (open.level < margins_.size()) {
+                    open.order = waiting_[open.level].emplace(open_mean, id).first;
+                    open.waiting = true;
+                }
+            }
+        }
+        const size_t id = first_ + candidates_.size();
+        candidates_.push_back({time, rate, 0, !margins_.empty(), {}});
+        if (!margins_.empty()) {
+            candidates_.back().order = waiting_[0].emplace(mean, id).first;
+        }
+        durations_.insert(durations_.end(), margins_.size(), -1);
+        last_time_ = time;
+        while (!candidates_.empty() && !candidates_.front().waiting && last_time_ - candidates_.front().time >= span_) {
+            pop(done);
+        }
+    }
+
+    template <typename Done>
+    void finish(Done done) {
+        while (!candidates_.empty() && last_time_ - candidates_.front().time >= span_) {
+            stop_waiting(candidates_.front());
+            pop(done);
+        }
+        candidates_.clear();
+        durations_.clear();
+        for (auto& waiting : waiting_) {
+            waiting.clear();
+        }
+    }
+
+ private:
+    candidate& at(size_t id) {
+        return candidates_[id - first_];
+    }
+
+    void stop_waiting(candidate& open) {
+        if (open.waiting) {
+            waiting_[open.level].erase(open.order);
+            open.waiting = false;
+        }
+    }
+
+    template <typename Done>
+    void pop(Done done) {
+        done(candidates_.front(), durations_.cbegin());
+        candidates_.pop_front();
+        durations_.erase(durations_.begin(), durations_.begin() + margins_.size());
+        ++first_;
+        expired_ = expired_ > 0 ? expired_ - 1 : 0;
+    }
+
+    const fxminutes span_;
+    Profit profit_;
+    const std::vector<double> margins_;
+    std::deque<candidate> candidates_;
+    std::deque<fxminutes> durations_;  // by margins for every candidate
+    size_t first_;                     // id of the front candidate
+    size_t expired_;                   // candidates before it are out of the timeout
+    fxminutes last_time_;
+    std::vector<std::set<std::pair<double, size_t>>> waiting_;  // by margins, by mean and id
+};
+
+std::vector<fxgenuine_positions> make_sweep(const std::vector<double>& margins) noexcept(false) {
+    if (!std::is_sorted(margins.cbegin(), margins.cend())) {
+        throw std::invalid_argument("Margins of the sweep should be sorted.");
+    }
+    std::vector<fxgenuine_positions> sweep;
+    for (const double margin : margins) {
+        sweep.push_back({margin, {}, 0, 0, 0});
+    }
+    return sweep;
+}
+
+// Outcomes of a done candidate are added in time order, so the durations are summed as the scan of them does.
+template <typename DurationsIterator>
+void add_outcomes(std::vector<fxgenuine_positions>& sweep, const boost::posix_time::ptime& time,
+                  DurationsIterator durations) {
+    for (auto& positions : sweep) {
+        const fxminutes duration = *durations++;
+        if (duration >= 0) {
+            positions.durat += static_cast<double>(duration);
+            positions.marks.emplace_back(time);
+        }
+    }
+}
+
+void complete_sweep(std::vector<fxgenuine_positions>& sweep, size_t count, double adjust) {
+    for (auto& positions : sweep) {
+        positions.adjust = adjust;
+        positions.durat /= positions.marks.empty() ? 1 : positions.marks.size();
+        positions.probab = double(positions.marks.size()) / double(count);
+    }
+}
+
+markers take_positions(fxgenuine_positions& positions, double& adjust, double& probab, double& durat) {
+    adjust = positions.adjust;
+    probab = positions.probab;
+    durat = positions.durat;
+    return std::move(positions.marks);
+}
+
+// Partitions are not split below this number of candles, a thread costs more than a sweep of a smaller range.
+const size_t fxMinSweepPartition = 1 << 15;
+
+// Outcomes of the open candidates in [first, last) of a random access sequence. Candles are pushed up to the first one
+// out of the timeout after the last candidate, so every candidate gets the same close and is counted the same way as
+// by the sweep of the whole sequence. Returns the number of the counted candidates.
+template <typename Profit, typename Minute, typename Mean, typename Time>
+size_t sweep_range(size_t first, size_t last, size_t size, fxminutes span, Profit profit, Minute minute_of,
+                   Mean mean_of, Time time_of, std::vector<fxgenuine_positions>& sweep) {
+    std::vector<double> margins;
+    for (const auto& positions : sweep) {
+        margins.push_back(positions.margin);
+    }
+    first_passage<size_t, Profit> passage(span, profit, margins);
+    size_t count = 0;
+    const auto done = [&](const auto& open, auto durations) {
+        if (open.rate < last) {
+            add_outcomes(sweep, time_of(open.rate), durations);
+            ++count;
+        }
+    };
+    if (first < last) {
+        const fxminutes end_time = minute_of(last - 1) + span;
+        for (size_t i = first; i < size && (i == first || minute_of(i - 1) <= end_time); i++) {
+            passage.push(minute_of(i), i, mean_of(i), done);
+        }
+    }
+    passage.finish(done);
+    return count;
+}
+
+// Sweeping partitions of the sequence by jobs threads (0 means the number of hardware threads), the partitions overlap
+// by the timeout and their outcomes are merged in order. Durations are whole minutes, so their sums are exact in any
+// order. Returns the number of the counted candidates.
+template <typename SweepRange>
+size_t sweep_partitions(size_t size, unsigned jobs, std::vector<fxgenuine_positions>& sweep, SweepRange sweep_range) {
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t parts = std::max<size_t>(1, std::min<size_t>(jobs, size / fxMinSweepPartition));
+    std::vector<std::vector<fxgenuine_positions>> partials(parts, sweep);
+    std::vector<size_t> counts(parts);
+    // An exception of a partition is rethrown after all the threads are joined.
+    std::vector<std::exception_ptr> errors(parts);
+    const auto sweep_part = [&](size_t p) {
+        try {
+            counts[p] = sweep_range(p * size / parts, (p + 1) * size / parts, partials[p]);
+        } catch (...) {
+            errors[p] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t p = 1; p < parts; p++) {
+        pool.emplace_back(sweep_part, p);
+    }
+    sweep_part(0);
+    for (auto& worker : pool) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    size_t count = 0;
+    for (size_t p = 0; p < parts; p++) {
+        for (size_t k = 0; k < sweep.size(); k++) {
+            auto& marks = sweep[k].marks;
+            marks.insert(marks.end(), partials[p][k].marks.cbegin(), partials[p][k].marks.cend());
+            sweep[k].durat += partials[p][k].durat;
+        }
+        count += counts[p];
+    }
+    return count;
+}
+
+// Mean open time in minutes between count candidates from the first till the last one, the calendar covers their days
+// only, so the candles may be out of the period of the sequence.
+double mean_open_minutes(const boost::posix_time::ptime& first, const boost::posix_time::ptime& last, size_t count) {
+    using namespace boost::posix_time;
+    const fxcalendar calendar(boost::gregorian::date_period((first - minutes(1)).date(),
+                                                            (last - minutes(1)).date() + boost::gregorian::days(1)));
+    return calendar.open_time(first, last).total_seconds() / 60.0 / (count - 1);
+}
+}  // namespace
+
 double MaxMargin(const fxprobab_coefs& pcoefs, const fxdurat_coefs& dcoefs, double tadust) {
     using namespace std;
     auto delta_1 = [&pcoefs, &dcoefs, tadust](double m) {
@@ -24,35 +282,125 @@ double MaxMargin(const fxprobab_coefs& pcoefs, const fxdurat_coefs& dcoefs, doub
     return syseq2.solve(m1)[0][0];
 }
 
+std::vector<fxgenuine_positions> GenuinePositions(const fxsequence& seq,
+                                                 const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                                                 const std::vector<double>& margins, unsigned jobs) noexcept(false) {
+    std::vector<fxgenuine_positions> sweep = make_sweep(margins);
+    const auto& rates = seq.candles;
+    const auto profit_of = [&rates, profit](size_t iclose, size_t iopen) {
+        return profit(rates[iclose], rates[iopen]);
+    };
+    const auto minute_of = [&rates](size_t i) { return ToEpochMinutes(rates[i].time); };
+    const auto mean_of = [&rates](size_t i) { return fxmean(rates[i]); };
+    const auto time_of = [&rates](size_t i) { return rates[i].time; };
+    const auto sweep_part = [&](size_t first, size_t last, std::vector<fxgenuine_positions>& part) {
+        return sweep_range(first, last, rates.size(), ToMinutes(timeout), profit_of, minute_of, mean_of, time_of, part);
+    };
+    const size_t count = sweep_partitions(rates.size(), jobs, sweep, sweep_part);
+    double adjust = 0;
+    if (count > 1) {
+        adjust = mean_open_minutes(rates.front().time, rates[count - 1].time, count);
+    }
+    complete_sweep(sweep, count, adjust);
+    return sweep;
+}
+
+std::vector<fxgenuine_positions> GenuinePositions(const fxseries& ser, const boost::posix_time::time_duration& timeout,
+                                                 fprofit_mean_t profit, const std::vector<double>& margins,
+                                                 unsigned jobs) noexcept(false) {
+    std::vector<fxgenuine_positions> sweep = make_sweep(margins);
+    const auto& means = ser.mean;
+    const auto profit_of = [&means, profit](size_t iclose, size_t iopen) {
+        return profit(means[iclose], means[iopen]);
+    };
+    const auto minute_of = [&ser](size_t i) { return ser.minute[i]; };
+    const auto mean_of = [&means](size_t i) { return means[i]; };
+    const auto time_of = [&ser](size_t i) { return ser.time[i]; };
+    const auto sweep_part = [&](size_t first, size_t last, std::vector<fxgenuine_positions>& part) {
+        return sweep_range(first, last, ser.size(), ToMinutes(timeout), profit_of, minute_of, mean_of, time_of, part);
+    };
+    const size_t count = sweep_partitions(ser.size(), jobs, sweep, sweep_part);
+    double adjust = 0;
+    if (count > 1) {
+        adjust = mean_open_minutes(ser.time.front(), ser.time[count - 1], count);
+    }
+    complete_sweep(sweep, count, adjust);
+    return sweep;
+}
+
+std::vector<fxgenuine_positions> GenuinePositions(fxsequence_reader& reader,
+                                                 const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                                                 const std::vector<double>& margins) noexcept(false) {
+    std::vector<fxgenuine_positions> sweep = make_sweep(margins);
+    boost::optional<boost::posix_time::ptime> first_time;
+    boost::posix_time::ptime last_time;
+    size_t count = 0;
+    first_passage<fxcandle, fprofit_t> passage(ToMinutes(timeout), profit, margins);
+    const auto done = [&](const auto& open, auto durations) {
+        add_outcomes(sweep, open.rate.time, durations);
+        if (!first_time.is_initialized()) {
+            first_time = open.rate.time;
+        }
+        last_time = open.rate.time;
+        ++count;
+    };
+    reader.rewind();
+    std::vector<fxcandle> batch;
+    while (reader.next_batch(batch)) {
+        for (const auto& candle : batch) {
+            passage.push(ToEpochMinutes(candle.time), candle, fxmean(candle), done);
+        }
+    }
+    passage.finish(done);
+    double adjust = 0;
+    if (count > 1) {
+        adjust = mean_open_minutes(*first_time, last_time, count);
+    }
+    complete_sweep(sweep, count, adjust);
+    return sweep;
+}
+
 markers GenuinePositions(const fxsequence& seq, const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                         double expected_margin, double& adjust, double& probab, double& durat, unsigned jobs) {
+    auto sweep = GenuinePositions(seq, timeout, profit, std::vector<double>{expected_margin}, jobs);
+    return take_positions(sweep.front(), adjust, probab, durat);
+}
+
+markers GenuinePositions(const fxseries& ser, const boost::posix_time::time_duration& timeout, fprofit_mean_t profit,
+                         double expected_margin, double& adjust, double& probab, double& durat, unsigned jobs) {
+    auto sweep = GenuinePositions(ser, timeout, profit, std::vector<double>{expected_margin}, jobs);
+    return take_positions(sweep.front(), adjust, probab, durat);
+}
+
+markers GenuinePositions(fxsequence_reader& reader, const boost::posix_time::time_duration& timeout, fprofit_t profit,
                          double expected_margin, double& adjust, double& probab, double& durat) {
-    using namespace std;
-    fxlib::markers marks;
-    adjust = 0;
-    durat = 0;
-    boost::optional<boost::posix_time::ptime> prev_time;
-    size_t count = 0;
-    const auto& rates = seq.candles;
-    for (auto iopen = rates.cbegin(); (iopen < rates.cend()) && (rates.back().time - iopen->time >= timeout);
-         ++iopen, ++count) {
-        for (auto iclose = iopen + 1; (iclose < rates.cend()) && (iclose->time - iopen->time <= timeout); ++iclose) {
-            if (profit(*iclose, *iopen) >= expected_margin) {
-                const boost::posix_time::time_duration dt = iclose->time - iopen->time;
-                durat += dt.total_seconds() / 60.0;
-                marks.emplace_back(iopen->time);
-                break;
-            }
+    auto sweep = GenuinePositions(reader, timeout, profit, std::vector<double>{expected_margin});
+    return take_positions(sweep.front(), adjust, probab, durat);
+}
+
+fxsliding_extremes::fxsliding_extremes(const fxseries& ser, const boost::posix_time::time_duration& timeout)
+    : ser_(ser), span_(ToMinutes(timeout)), next_(0) {}
+
+bool fxsliding_extremes::open(size_t iopen) {
+    const auto& means = ser_.mean;
+    const fxminutes close_limit = ser_.minute[iopen] + span_;
+    for (next_ = std::max(next_, iopen + 1); next_ < ser_.size() && ser_.minute[next_] <= close_limit; ++next_) {
+        while (!max_.empty() && means[max_.back()] < means[next_]) {
+            max_.pop_back();
         }
-        if (prev_time.is_initialized()) {
-            const boost::posix_time::time_duration dt = iopen->time - *prev_time;
-            adjust += dt.total_seconds() / 60.0;
+        max_.push_back(next_);
+        while (!min_.empty() && means[min_.back()] > means[next_]) {
+            min_.pop_back();
         }
-        prev_time = iopen->time;
+        min_.push_back(next_);
+    }
+    while (!max_.empty() && max_.front() <= iopen) {
+        max_.pop_front();
+    }
+    while (!min_.empty() && min_.front() <= iopen) {
+        min_.pop_front();
     }
-    adjust /= count > 1 ? (count - 1) : 1;
-    durat /= marks.empty() ? 1 : marks.size();
-    probab = double(marks.size()) / double(count);
-    return marks;
+    return !max_.empty();
 }
 
 }  // namespace fxlib
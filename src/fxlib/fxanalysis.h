@@ -2,6 +2,9 @@
 
 #include "fxmath.h"
 #include "fxquote.h"
+#include "fxseries.h"
+
+#include <deque>
 
 namespace fxlib {
 
@@ -9,7 +12,66 @@ using markers = std::vector<boost::posix_time::ptime>;
 
 double MaxMargin(const fxprobab_coefs& pcoefs, const fxdurat_coefs& dcoefs, double tadust);
 
+// The adjust is mean open time in minutes between open candidates (see fxcalendar) by the days of the candles, the
+// period of the sequence may not cover them. The profit should depend on the open candle by its mean monotonically as
+// fxprofit_long/short do, so the first close of every candidate is found in O(N log W) for W candles within the
+// timeout. A long sequence is split into partitions overlapping by the timeout that are swept by jobs threads (0 means
+// the number of hardware threads), the result is the same for any number of jobs.
 markers GenuinePositions(const fxsequence& seq, const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                         double expected_margin, double& adjust, double& probab, double& durat, unsigned jobs = 0);
+markers GenuinePositions(const fxseries& ser, const boost::posix_time::time_duration& timeout, fprofit_mean_t profit,
+                         double expected_margin, double& adjust, double& probab, double& durat, unsigned jobs = 0);
+// Reading the whole sequence by batches from the first candle, only candles within the timeout are kept in memory.
+markers GenuinePositions(fxsequence_reader& reader, const boost::posix_time::time_duration& timeout, fprofit_t profit,
                          double expected_margin, double& adjust, double& probab, double& durat);
 
+// Genuine positions for a margin of a sweep, the same as GenuinePositions gives for the margin alone.
+struct fxgenuine_positions {
+    double margin;
+    markers marks;
+    double adjust;
+    double probab;
+    double durat;
+};
+
+// Sweeping the sorted margins by a single pass, the results are in order of the margins.
+std::vector<fxgenuine_positions> GenuinePositions(const fxsequence& seq,
+                                                 const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                                                 const std::vector<double>& margins,
+                                                 unsigned jobs = 0) noexcept(false);
+std::vector<fxgenuine_positions> GenuinePositions(const fxseries& ser, const boost::posix_time::time_duration& timeout,
+                                                 fprofit_mean_t profit, const std::vector<double>& margins,
+                                                 unsigned jobs = 0) noexcept(false);
+std::vector<fxgenuine_positions> GenuinePositions(fxsequence_reader& reader,
+                                                 const boost::posix_time::time_duration& timeout, fprofit_t profit,
+                                                 const std::vector<double>& margins) noexcept(false);
+
+// Extremes of the means within the timeout after the open candles of a series, in O(1) amortized for every candle.
+/*
+  The candles are opened in order of time, the window (open, open + timeout] of every open candle is moved forward
+  by the candles, and monotonic deques of them give the candles with the maximal and minimal means. The candles with
+  equal means are kept in order of time, so the earliest extremes are given as a scan of the window finds them.
+*/
+class fxsliding_extremes {
+ public:
+    fxsliding_extremes(const fxseries& ser, const boost::posix_time::time_duration& timeout);
+
+    // Moves the window to the open candle, returns false if there are no candles within the timeout after it.
+    bool open(size_t iopen);
+    // The earliest candles of the window with the maximal and minimal means.
+    size_t max_index() const {
+        return max_.front();
+    }
+    size_t min_index() const {
+        return min_.front();
+    }
+
+ private:
+    const fxseries& ser_;
+    const fxminutes span_;
+    size_t next_;  // the first candle that has not been pushed to the window
+    std::deque<size_t> max_;
+    std::deque<size_t> min_;
+};
+
 }  // namespace fxlib
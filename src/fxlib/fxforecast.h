@@ -33,6 +33,8 @@ struct IForecaster {
       Return estimation in the range [0,1):
       0 - means absolutely negative cast;
       1 - means 100% positive cast.
+      Candles should be fed in strict time order since the reset, an algorithm may throw std::logic_error on a
+      repeated or earlier candle.
     */
     virtual double Feed(const fxcandle&) = 0;
     /// Reset an algorithm to the begin condition in order to start new feeding.
@@ -45,6 +47,8 @@ struct IForecaster {
 
 struct ITrainer {
     virtual void PrepareTrainingSet(const fxsequence&, std::ostream&) const = 0;
+    /// The same, packed quotes are taken from the pyramid when it has the needed level.
+    virtual void PrepareTrainingSet(const fxsequence&, const fxpyramid&, std::ostream&) const = 0;
     virtual boost::property_tree::ptree LoadAndTrain(std::istream&) = 0;
     virtual ~ITrainer() {}
 };
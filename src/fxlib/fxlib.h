@@ -2,6 +2,7 @@
 
 #include "fxtime.h"
 #include "fxquote.h"
+#include "fxseries.h"
 #include "fxcurrencies.h"
 #include "fxanalysis.h"
 #include "fxforecast.h"
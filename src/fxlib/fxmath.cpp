@@ -2,10 +2,139 @@
 #include "math/mathlib/approx.h"
 #include "math/mathlib/fapprox.h"
 
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
 
 namespace fxlib {
 
+namespace {
+// Shorter sequences are sorted by std::stable_sort, passes of radix sort over them cost more.
+const size_t fxMinRadixSort = 1 << 8;
+// Parts are not split below this number of samples, a thread costs more than a pass over a smaller part.
+const size_t fxMinSortPartition = 1 << 16;
+// Digits of 11 bits take 6 passes over 64 bits of a key, counts of a digit fit into L1 cache.
+const int fxRadixBits = 11;
+const size_t fxRadix = size_t(1) << fxRadixBits;
+const int fxRadixPasses = (64 + fxRadixBits - 1) / fxRadixBits;
+
+using radix_counts = std::array<size_t, fxRadix>;
+
+// Unsigned integer in the same order as the margin: negative margins are inverted, the sign bit is set for others.
+// Both of the zeros are given the same key as they are equal margins.
+uint64_t radix_key(double margin) {
+    const double value = margin == 0 ? 0.0 : margin;
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) != 0 ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+size_t radix_digit(uint64_t key, int pass) {
+    return static_cast<size_t>(key >> (pass * fxRadixBits)) & (fxRadix - 1);
+}
+
+template <typename Work>
+void run_parts(size_t parts, Work work) {
+    // An exception of a part is rethrown after all the threads are joined.
+    std::vector<std::exception_ptr> errors(parts);
+    const auto run_part = [&](size_t p) {
+        try {
+            work(p);
+        } catch (...) {
+            errors[p] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t p = 1; p < parts; p++) {
+        pool.emplace_back(run_part, p);
+    }
+    run_part(0);
+    for (auto& worker : pool) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+}  // namespace
+
+fxmargin_samples& fxsort(fxmargin_samples& samples, unsigned jobs) {
+    const size_t size = samples.size();
+    if (size < fxMinRadixSort) {
+        std::stable_sort(samples.begin(), samples.end(), [](const fxmargin_sample& lhs, const fxmargin_sample& rhs) {
+            return lhs.margin < rhs.margin;
+        });
+        return samples;
+    }
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t parts = std::max<size_t>(1, std::min<size_t>(jobs, size / fxMinSortPartition));
+    fxmargin_samples buffer(size);
+    fxmargin_sample* from = samples.data();
+    fxmargin_sample* to = buffer.data();
+    // Counts of the digits of all the passes by one pass over the parts. The sums over the parts do not depend on the
+    // order of samples, but the counts of a part have to be recounted after samples have been moved between the parts.
+    std::vector<std::array<radix_counts, fxRadixPasses>> counts(parts);
+    const auto count_part = [&](size_t p, int first_pass, int last_pass) {
+        for (int pass = first_pass; pass < last_pass; pass++) {
+            counts[p][pass].fill(0);
+        }
+        for (size_t i = p * size / parts; i < (p + 1) * size / parts; i++) {
+            const uint64_t key = radix_key(from[i].margin);
+            for (int pass = first_pass; pass < last_pass; pass++) {
+                ++counts[p][pass][radix_digit(key, pass)];
+            }
+        }
+    };
+    run_parts(parts, [&](size_t p) { count_part(p, 0, fxRadixPasses); });
+    bool moved = false;
+    for (int pass = 0; pass < fxRadixPasses; pass++) {
+        bool same_digit = false;
+        for (size_t digit = 0; digit < fxRadix && !same_digit; digit++) {
+            size_t total = 0;
+            for (const auto& part_counts : counts) {
+                total += part_counts[pass][digit];
+            }
+            same_digit = total == size;
+        }
+        if (same_digit) {
+            continue;  // the pass would not move any sample
+        }
+        if (moved && parts > 1) {
+            run_parts(parts, [&](size_t p) { count_part(p, pass, pass + 1); });
+        }
+        // Samples with a digit go in order of the parts, so every pass is stable.
+        size_t offset = 0;
+        for (size_t digit = 0; digit < fxRadix; digit++) {
+            for (auto& part_counts : counts) {
+                const size_t n = part_counts[pass][digit];
+                part_counts[pass][digit] = offset;
+                offset += n;
+            }
+        }
+        run_parts(parts, [&](size_t p) {
+            auto& next = counts[p][pass];
+            for (size_t i = p * size / parts; i < (p + 1) * size / parts; i++) {
+                to[next[radix_digit(radix_key(from[i].margin), pass)]++] = from[i];
+            }
+        });
+        std::swap(from, to);
+        moved = true;
+    }
+    if (from != samples.data()) {
+        samples.swap(buffer);
+    }
+    return samples;
+}
+
 void MarginStats(const fxmargin_samples& samples, double& mean, double& variance) {
     mean = 0.0;
     for (const auto& s : samples) {
@@ -93,24 +222,21 @@ fxdurat_distribution MarginDurationDistribution(const fxmargin_samples& samples,
                                                 const double step) {
     using citer = fxmargin_samples::const_iterator;
     auto worker = [end = samples.end()](citer & iter, fxduration_sample & sample) {
-        std::vector<double> time_collector;
+        const citer first = iter;
         while ((iter < end) && (iter->margin < sample.bound)) {
-            time_collector.push_back(iter->period);
+            sample.durat += iter->period;
             ++iter;
         }
-        if (!time_collector.empty()) {
-            for (const double& t : time_collector) {
-                sample.durat += t;
-            }
-            sample.durat /= time_collector.size();
-            if (time_collector.size() > 1) {
-                for (const double& t : time_collector) {
-                    const double d = t - sample.durat;
+        sample.count = static_cast<size_t>(iter - first);
+        if (sample.count > 0) {
+            sample.durat /= sample.count;
+            if (sample.count > 1) {
+                for (citer it = first; it < iter; ++it) {
+                    const double d = it->period - sample.durat;
                     sample.error += d * d;
                 }
-                sample.error = sqrt(sample.error / (time_collector.size() - 1));
+                sample.error = sqrt(sample.error / (sample.count - 1));
             }
-            sample.count = time_collector.size();
         }
     };
 
@@ -132,6 +258,55 @@ fxdurat_distribution MarginDurationDistribution(const fxmargin_samples& samples,
     return distrib;
 }
 
+fxmargin_distributions MarginDistributions(const fxmargin_samples& samples, size_t distr_size, const double from,
+                                           const double step) {
+    fxmargin_distributions distribs;
+    auto& distrib = distribs.distrib;
+    auto& probab = distribs.probab;
+    auto& durats = distribs.durats;
+    distrib.reserve(distr_size + 3);  // there are two extra data and (distr_size+1) values
+    probab.reserve(distr_size + 3);
+    durats.reserve(distr_size + 3);
+    for (size_t i = 0; i <= distr_size + 2; i++) {
+        const double bound = i == 0 ? from - step : from + (i - 1) * step;
+        distrib.push_back({bound, 0});
+        probab.push_back({bound, 0});
+        durats.push_back(fxduration_sample{bound});
+    }
+    // A sample is counted by the distribution at the first bound that is not less than its margin and by the durations
+    // at the first bound that is greater, so both of the bounds only go forward for the sorted samples.
+    const size_t beyond = distr_size + 2;  // remaining data beyond the interval
+    size_t idistrib = 0;
+    size_t idurat = 0;
+    for (const auto& s : samples) {
+        while (idistrib < beyond && distrib[idistrib].bound < s.margin) {
+            ++idistrib;
+        }
+        while (idurat < beyond && durats[idurat].bound <= s.margin) {
+            ++idurat;
+        }
+        ++distrib[idistrib].count;
+        // Welford's update: durat is the running mean and error is the sum of squared deviations from it.
+        fxduration_sample& sample = durats[idurat];
+        ++sample.count;
+        const double delta = s.period - sample.durat;
+        sample.durat += delta / sample.count;
+        sample.error += delta * (s.period - sample.durat);
+    }
+    size_t count = samples.size();
+    for (size_t i = 0; i < beyond; i++) {
+        count -= durats[i].count;
+        probab[i].count = count;
+        probab[i].prob = static_cast<double>(count) / static_cast<double>(samples.size());
+        durats[i].error = durats[i].count > 1 ? std::sqrt(durats[i].error / (durats[i].count - 1)) : 0;
+    }
+    probab[beyond].count = count;
+    probab[beyond].prob = static_cast<double>(count) / static_cast<double>(samples.size());
+    durats[beyond].durat = 0;
+    durats[beyond].error = 0;
+    return distribs;
+}
+
 fxdurat_coefs ApproxDurationDistribution(const fxdurat_distribution& distrib) {
     using namespace std;
     const size_t good_interval = 2 * (distrib.size() - 3) / 3 + 1;
@@ -152,4 +327,65 @@ fxdurat_coefs ApproxDurationDistribution(const fxdurat_distribution& distrib) {
     return {get<0>(res), get<1>(res)};
 }
 
+void fxrunning_stats::merge(const fxrunning_stats& other) {
+    if (other.count_ == 0) {
+        return;
+    }
+    const double count = static_cast<double>(count_ + other.count_);
+    const double delta = other.mean_ - mean_;
+    mean_ += delta * static_cast<double>(other.count_) / count;
+    m2_ += other.m2_ + delta * delta * static_cast<double>(count_) * static_cast<double>(other.count_) / count;
+    count_ += other.count_;
+}
+
+fxmargin_histogram::fxmargin_histogram(size_t distr_size, double from, double step)
+    : counts_(distr_size + 3), durats_(distr_size + 3), size_(0) {
+    // The bounds are calculated as MarginDistribution does to compare the margins with the same values.
+    bounds_.reserve(distr_size + 3);
+    bounds_.push_back(from - step);
+    for (size_t i = 0; i <= distr_size + 1; i++) {
+        bounds_.push_back(from + i * step);
+    }
+}
+
+void fxmargin_histogram::add(const fxmargin_sample& sample) {
+    // The last bound is the one of the remaining data beyond the interval.
+    const auto first = bounds_.cbegin();
+    const auto last = std::prev(bounds_.cend());
+    ++counts_[std::lower_bound(first, last, sample.margin) - first];
+    durats_[std::upper_bound(first, last, sample.margin) - first].add(sample.period);
+    ++size_;
+}
+
+void fxmargin_histogram::merge(const fxmargin_histogram& other) noexcept(false) {
+    if (bounds_ != other.bounds_) {
+        throw std::logic_error("Histograms with different bounds cannot be merged.");
+    }
+    for (size_t i = 0; i < counts_.size(); i++) {
+        counts_[i] += other.counts_[i];
+        durats_[i].merge(other.durats_[i]);
+    }
+    size_ += other.size_;
+}
+
+fxmargin_distributions fxmargin_histogram::distributions() const {
+    fxmargin_distributions distribs;
+    distribs.distrib.reserve(bounds_.size());
+    distribs.probab.reserve(bounds_.size());
+    distribs.durats.reserve(bounds_.size());
+    size_t count = size_;
+    for (size_t i = 0; i < bounds_.size(); i++) {
+        const fxrunning_stats& durat = durats_[i];
+        const bool beyond = i + 1 == bounds_.size();  // remaining data beyond the interval
+        if (!beyond) {
+            count -= durat.count();
+        }
+        distribs.distrib.push_back({bounds_[i], counts_[i]});
+        distribs.probab.push_back({bounds_[i], count, static_cast<double>(count) / static_cast<double>(size_)});
+        distribs.durats.push_back(
+            {bounds_[i], durat.count(), beyond ? 0 : durat.mean(), beyond ? 0 : durat.variance()});
+    }
+    return distribs;
+}
+
 }  // namespace fxlib
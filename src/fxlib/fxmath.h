@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 namespace fxlib {
 
@@ -54,11 +55,13 @@ struct fxdurat_coefs {
     double lambda;
 };
 
-static inline fxmargin_samples& fxsort(fxmargin_samples& samples) {
-    std::sort(samples.begin(), samples.end(),
-              [](const fxmargin_sample& lhs, const fxmargin_sample& rhs) { return lhs.margin < rhs.margin; });
-    return samples;
-}
+/// Sort margin samples by margin.
+/**
+  Samples are sorted by LSD radix sort on the IEEE 754 bits of the margins that is stable, samples with equal margins
+  keep their order. A long sequence is split into parts for jobs threads (0 means the number of hardware threads), the
+  result is the same for any number of jobs.
+*/
+fxmargin_samples& fxsort(fxmargin_samples& samples, unsigned jobs = 0);
 
 /// Calculate the mean and the variance values for sequence of samples.
 void MarginStats(const fxmargin_samples& samples, double& mean, double& variance);
@@ -91,6 +94,21 @@ static inline double margin_probab(const fxprobab_coefs& coefs, double m) {
 fxdurat_distribution MarginDurationDistribution(const fxmargin_samples& samples, size_t distr_size, const double from,
                                                 const double step);
 
+/// Distribution, probability and duration distribution of the same margin samples.
+struct fxmargin_distributions {
+    fxmargin_distribution distrib;
+    fxmargin_probability probab;
+    fxdurat_distribution durats;
+};
+
+/// Build distribution, probability and duration distribution for sequence of margin samples by a single pass.
+/**
+  The sequence of margin samples must be sorted. The results are the same as MarginDistribution, MarginProbability
+  and MarginDurationDistribution give, the durations are accumulated in place by Welford's method.
+*/
+fxmargin_distributions MarginDistributions(const fxmargin_samples& samples, size_t distr_size, const double from,
+                                           const double step);
+
 /// Approximate margin duration distribution.
 fxdurat_coefs ApproxDurationDistribution(const fxdurat_distribution& distrib);
 
@@ -98,6 +116,64 @@ static inline double margin_duration(const fxdurat_coefs& coefs, double m) {
     return coefs.T * (1 - std::exp(-coefs.lambda * m));
 }
 
+/// Running mean and variance of values in constant memory.
+/**
+  Values are added by Welford's method, so the stats do not lose precision on long sequences. The stats of two parts of
+  a sequence can be merged as if they have been collected by a single pass.
+*/
+class fxrunning_stats {
+ public:
+    void add(double value) {
+        ++count_;
+        const double delta = value - mean_;
+        mean_ += delta / static_cast<double>(count_);
+        m2_ += delta * (value - mean_);
+    }
+
+    void merge(const fxrunning_stats& other);
+
+    size_t count() const {
+        return count_;
+    }
+    double mean() const {
+        return mean_;
+    }
+    /// The square root of the sample variance as MarginStats gives it.
+    double variance() const {
+        return count_ > 1 ? std::sqrt(m2_ / static_cast<double>(count_ - 1)) : 0;
+    }
+
+ private:
+    size_t count_ = 0;
+    double mean_ = 0;
+    double m2_ = 0;  // sum of squared deviations from the mean
+};
+
+/// Distribution, probability and duration distribution of margin samples over fixed bounds in constant memory.
+/**
+  Samples are added in any order and are not kept, the results are the same as MarginDistributions gives for the sorted
+  samples with the same bounds (up to rounding of the durations).
+  Histograms with the same bounds can be merged.
+*/
+class fxmargin_histogram {
+ public:
+    fxmargin_histogram(size_t distr_size, double from, double step);
+
+    void add(const fxmargin_sample& sample);
+    void merge(const fxmargin_histogram& other) noexcept(false);
+
+    size_t size() const {
+        return size_;
+    }
+    fxmargin_distributions distributions() const;
+
+ private:
+    std::vector<double> bounds_;
+    std::vector<size_t> counts_;           // by margin <= bound as MarginDistribution does
+    std::vector<fxrunning_stats> durats_;  // by margin < bound as MarginProbability does
+    size_t size_;
+};
+
 static inline double margin_yield(const fxprobab_coefs& pcoefs, const fxdurat_coefs& dcoefs, double tadust, double m) {
     const double P = margin_probab(pcoefs, m);
     const double D = margin_duration(dcoefs, m);
@@ -2,106 +2,1160 @@
 #include "helpers/fxquote_serializable.h"
 #include "helpers/fxtime_conversion.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
 namespace fxlib {
 
-void WriteSequence(std::ostream& out, const fxsequence& seq) noexcept(false) {
+namespace {
+fxcandle candle_from_bin(const detail::fxcandle_bin& candle) {
+    return {conversion::to_ptime(candle.time),
+            static_cast<double>(candle.open) * 1e-6,
+            static_cast<double>(candle.close) * 1e-6,
+            static_cast<double>(candle.high) * 1e-6,
+            static_cast<double>(candle.low) * 1e-6,
+            candle.volume};
+}
+
+void candle_from_bin(const detail::fxcandle_bin& candle, fxcandle& c) {
+    c = candle_from_bin(candle);
+}
+
+void candle_from_bin(const detail::fxcandle_bin& candle, fxminute_candle& c) {
+    c = {conversion::to_epoch_minutes(candle.time),
+         static_cast<double>(candle.open) * 1e-6,
+         static_cast<double>(candle.close) * 1e-6,
+         static_cast<double>(candle.high) * 1e-6,
+         static_cast<double>(candle.low) * 1e-6,
+         candle.volume};
+}
+
+boost::gregorian::date_period period_from_bin(const fxtime& start, const fxtime& end) {
+    return boost::gregorian::date_period(conversion::to_ptime(start).date(), conversion::to_ptime(end).date());
+}
+
+// Candles belong to days of a period when their time is in (begin 00:00, end 00:00], 00:00 means the last quote of
+// previous day.
+bool in_period(const boost::posix_time::ptime& time, const boost::gregorian::date_period& period) {
+    return time > boost::posix_time::ptime(period.begin()) && time <= boost::posix_time::ptime(period.end());
+}
+
+// Index of the first of sorted candles whose time is after the bound, time_at(idx) returns the time of a candle.
+template <typename TimeAt>
+size_t upper_candle(size_t count, const boost::posix_time::ptime& bound, TimeAt time_at) {
+    size_t first = 0;
+    while (count > 0) {
+        const size_t half = count / 2;
+        if (time_at(first + half) <= bound) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
+const boost::gregorian::date_period whole_period(boost::gregorian::date(boost::date_time::min_date_time),
+                                                 boost::gregorian::date(boost::date_time::max_date_time));
+
+// Compressed format (v2).
+// Every candle of a block is stored as varints: zigzag deltas of the time in seconds to the previous candle, the open
+// to the previous close, the close to the open, the high to max(open, close), min(open, close) to the low, and the
+// volume. Prices are stored in units of the block, the first candle is encoded against zeros.
+
+const size_t block_candles = 1440;  // about a day of minute quotes
+const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+// Rounding keeps prices of a read sequence intact when it is written again.
+uint32_t to_millionth(double price) {
+    return static_cast<uint32_t>(std::llround(price * 1e6));
+}
+
+detail::fxcandle_bin candle_to_bin(const fxcandle& c) {
+    detail::fxcandle_bin candle;
+    candle.time = conversion::from_ptime(c.time);
+    candle.open = to_millionth(c.open);
+    candle.close = to_millionth(c.close);
+    candle.high = to_millionth(c.high);
+    candle.low = to_millionth(c.low);
+    candle.volume = static_cast<uint16_t>(c.volume);
+    return candle;
+}
+
+uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        const uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+void put_varint(std::vector<uint8_t>& buf, uint64_t v) {
+    while (v >= 0x80) {
+        buf.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    buf.push_back(static_cast<uint8_t>(v));
+}
+
+uint64_t get_varint(const uint8_t*& pos, const uint8_t* end) noexcept(false) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        const uint8_t b = *pos++;
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            return v;
+        }
+    }
+    throw std::logic_error("Corrupted block of candles.");
+}
+
+// Volumes are cut to 16 bits as in the plain format unless full_volume is set.
+detail::fxblock_header_bin encode_block(const fxcandle* candles, size_t count, std::vector<uint8_t>& buf,
+                                        bool full_volume) noexcept(false) {
+    uint32_t unit = 0;
+    for (size_t i = 0; i < count; i++) {
+        unit = gcd(unit, to_millionth(candles[i].open));
+        unit = gcd(unit, to_millionth(candles[i].close));
+        unit = gcd(unit, to_millionth(candles[i].high));
+        unit = gcd(unit, to_millionth(candles[i].low));
+    }
+    if (unit == 0) {
+        unit = 1;
+    }
+    const size_t start = buf.size();
+    int64_t prev_time = 0;
+    int64_t prev_close = 0;
+    for (size_t i = 0; i < count; i++) {
+        const fxcandle& c = candles[i];
+        if (c.time.is_special()) {
+            throw std::logic_error("Invalid candle time.");
+        }
+        const int64_t time = (c.time - epoch).total_seconds();
+        const int64_t open = to_millionth(c.open) / unit;
+        const int64_t close = to_millionth(c.close) / unit;
+        const int64_t high = to_millionth(c.high) / unit;
+        const int64_t low = to_millionth(c.low) / unit;
+        put_varint(buf, zigzag(time - prev_time));
+        put_varint(buf, zigzag(open - prev_close));
+        put_varint(buf, zigzag(close - open));
+        put_varint(buf, zigzag(high - std::max(open, close)));
+        put_varint(buf, zigzag(std::min(open, close) - low));
+        put_varint(buf, full_volume ? c.volume : static_cast<uint16_t>(c.volume));
+        prev_time = time;
+        prev_close = close;
+    }
+    return {static_cast<uint32_t>(count), static_cast<uint32_t>(buf.size() - start), unit};
+}
+
+// Time of a decoded candle from seconds since the epoch.
+void set_candle_time(int64_t time, fxcandle& c) {
+    using namespace boost::posix_time;
+    const int64_t mins = (time >= 0 ? time : time - 59) / 60;
+    c.time = epoch + minutes(static_cast<long>(mins)) + seconds(static_cast<long>(time - mins * 60));
+}
+
+void set_candle_time(int64_t time, fxminute_candle& c) {
+    c.time = (time >= 0 ? time : time - 59) / 60;
+}
+
+fxminutes candle_minutes(const fxcandle& c) {
+    return ToEpochMinutes(c.time);
+}
+
+fxminutes candle_minutes(const fxminute_candle& c) {
+    return c.time;
+}
+
+template <typename Candle>
+void decode_block(const detail::fxblock_header_bin& block, const uint8_t* data,
+                  std::vector<Candle>& candles) noexcept(false) {
+    const uint8_t* pos = data;
+    const uint8_t* const end = data + block.size;
+    const auto price = [unit = block.price_unit](int64_t v) {
+        return static_cast<double>(static_cast<uint32_t>(v * unit)) * 1e-6;
+    };
+    int64_t time = 0;
+    int64_t close = 0;
+    for (uint32_t i = 0; i < block.count; i++) {
+        time += unzigzag(get_varint(pos, end));
+        const int64_t open = close + unzigzag(get_varint(pos, end));
+        close = open + unzigzag(get_varint(pos, end));
+        const int64_t high = std::max(open, close) + unzigzag(get_varint(pos, end));
+        const int64_t low = std::min(open, close) - unzigzag(get_varint(pos, end));
+        const size_t volume = static_cast<size_t>(get_varint(pos, end));
+        Candle c;
+        set_candle_time(time, c);
+        c.open = price(open);
+        c.close = price(close);
+        c.high = price(high);
+        c.low = price(low);
+        c.volume = volume;
+        candles.push_back(c);
+    }
+    if (pos != end) {
+        throw std::logic_error("Corrupted block of candles.");
+    }
+}
+
+// Encoding candles into blocks of block_candles, the encoded data of the blocks follow each other.
+void encode_blocks(const std::vector<fxcandle>& candles, std::vector<detail::fxblock_header_bin>& blocks,
+                   std::vector<uint8_t>& data, bool full_volume = false) noexcept(false) {
+    for (size_t first = 0; first < candles.size(); first += block_candles) {
+        const size_t count = std::min(block_candles, candles.size() - first);
+        blocks.push_back(encode_block(&candles[first], count, data, full_volume));
+    }
+}
+
+// Writing encoded blocks at the offset of the file, their entries are added to the index.
+void write_blocks(std::ostream& out, uint64_t offset, const std::vector<fxcandle>& candles,
+                  const std::vector<detail::fxblock_header_bin>& blocks, const std::vector<uint8_t>& data,
+                  std::vector<detail::fxblock_index_bin>& index) noexcept(false) {
+    size_t first = 0;
+    const uint8_t* block_data = data.data();
+    for (const auto& block : blocks) {
+        out << block;
+        out.write(reinterpret_cast<const char*>(block_data), block.size);
+        index.push_back({conversion::from_ptime(candles[first].time),
+                         conversion::from_ptime(candles[first + block.count - 1].time), block.count, offset});
+        offset += sizeof(block) + block.size;
+        first += block.count;
+        block_data += block.size;
+    }
+}
+
+void write_compressed(std::ostream& out, const fxsequence& seq, bool full_volume = false) noexcept(false) {
+    using namespace boost::posix_time;
+    std::vector<detail::fxblock_header_bin> blocks;
+    std::vector<uint8_t> data;
+    encode_blocks(seq.candles, blocks, data, full_volume);
+    detail::fxsequence_header_v2_bin header;
+    std::memcpy(header.magic, detail::fxsequence_magic_v2, sizeof(header.magic));
+    header.periodicity = static_cast<detail::fxperiodicity_bin>(seq.periodicity.total_seconds() / 60);
+    header.count = static_cast<uint32_t>(seq.candles.size());
+    header.period.start = conversion::from_ptime(ptime(seq.period.begin()));
+    header.period.end = conversion::from_ptime(ptime(seq.period.end()));
+    header.block_count = static_cast<uint32_t>(blocks.size());
+    header.index_offset = sizeof(header) + blocks.size() * sizeof(detail::fxblock_header_bin) + data.size();
+    out << header;
+    std::vector<detail::fxblock_index_bin> index;
+    write_blocks(out, sizeof(header), seq.candles, blocks, data, index);
+    for (const auto& entry : index) {
+        out << entry;
+    }
+    out.flush();
+}
+
+// Reading the block index of a compressed sequence that starts at the position of the stream. A block holds from one
+// to block_candles candles and the index should fit into the stream, so a corrupt header does not make a huge
+// allocation.
+std::vector<detail::fxblock_index_bin> read_index(std::istream& in, std::streampos start,
+                                                  const detail::fxsequence_header_v2_bin& header) noexcept(false) {
+    if (!in) {
+        throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+    }
+    in.seekg(0, std::ios_base::end);
+    const std::streamoff size = in.tellg() - start;
+    if (!in || size < 0 || header.index_offset > static_cast<uint64_t>(size) ||
+        (static_cast<uint64_t>(size) - header.index_offset) / sizeof(detail::fxblock_index_bin) < header.block_count) {
+        throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+    }
+    if (header.block_count > header.count || header.count > uint64_t(header.block_count) * block_candles) {
+        throw std::logic_error("Number of blocks does not match the header.");
+    }
+    std::vector<detail::fxblock_index_bin> index(header.block_count);
+    in.seekg(start + std::streamoff(header.index_offset));
+    for (auto& entry : index) {
+        in >> entry;
+    }
+    if (!in) {
+        throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+    }
+    return index;
+}
+
+// Reading of a compressed sequence, the magic has been already read. Blocks are found by the index since appended
+// blocks follow dead space of the replaced index.
+fxsequence read_compressed(std::istream& in) noexcept(false) {
+    using namespace boost::posix_time;
+    const std::streampos start = in.tellg() - std::streamoff(sizeof(detail::fxsequence_magic_v2));
+    detail::fxsequence_header_v2_bin header;
+    in.read(reinterpret_cast<char*>(&header) + sizeof(header.magic), sizeof(header) - sizeof(header.magic));
+    const std::vector<detail::fxblock_index_bin> index = read_index(in, start, header);
+    fxsequence seq = {minutes(header.periodicity), period_from_bin(header.period.start, header.period.end), {}};
+    seq.candles.reserve(header.count);
+    std::vector<uint8_t> data;
+    for (const auto& entry : index) {
+        in.seekg(start + std::streamoff(entry.offset));
+        detail::fxblock_header_bin block;
+        in >> block;
+        data.resize(block.size);
+        in.read(reinterpret_cast<char*>(data.data()), block.size);
+        if (!in) {
+            throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+        }
+        decode_block(block, data.data(), seq.candles);
+    }
+    if (seq.candles.size() != header.count) {
+        throw std::logic_error("Number of candles does not match the header.");
+    }
+    return seq;
+}
+
+// Reading candles of the period only, the blocks are found by the index.
+fxsequence read_compressed(std::istream& in, const boost::gregorian::date_period& period) noexcept(false) {
+    using namespace boost::posix_time;
+    const std::streampos start = in.tellg() - std::streamoff(sizeof(detail::fxsequence_magic_v2));
+    detail::fxsequence_header_v2_bin header;
+    in.read(reinterpret_cast<char*>(&header) + sizeof(header.magic), sizeof(header) - sizeof(header.magic));
+    const std::vector<detail::fxblock_index_bin> index = read_index(in, start, header);
+    fxsequence seq = {minutes(header.periodicity),
+                      period_from_bin(header.period.start, header.period.end).intersection(period), {}};
+    std::vector<uint8_t> data;
+    std::vector<fxcandle> candles;
+    for (const auto& entry : index) {
+        if (conversion::to_ptime(entry.last) <= ptime(period.begin()) ||
+            conversion::to_ptime(entry.first) > ptime(period.end())) {
+            continue;
+        }
+        in.seekg(start + std::streamoff(entry.offset));
+        detail::fxblock_header_bin block;
+        in >> block;
+        data.resize(block.size);
+        in.read(reinterpret_cast<char*>(data.data()), block.size);
+        if (!in) {
+            throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+        }
+        candles.clear();
+        decode_block(block, data.data(), candles);
+        for (const auto& c : candles) {
+            if (in_period(c.time, period)) {
+                seq.candles.push_back(c);
+            }
+        }
+    }
+    return seq;
+}
+
+// Reading candles of the period only, the first and last candles are found by the binary search.
+fxsequence read_plain(std::istream& in, const detail::fxsequence_header_bin& header,
+                      const boost::gregorian::date_period& period) noexcept(false) {
+    using namespace boost::posix_time;
+    const std::streampos base = in.tellg();
+    const auto time_at = [&in, base](size_t idx) {
+        in.seekg(base + std::streamoff(idx * sizeof(detail::fxcandle_bin)));
+        fxtime time;
+        in >> time.data;
+        if (!in) {
+            throw std::ios_base::failure("Unexpected end of a sequence.");
+        }
+        return conversion::to_ptime(time);
+    };
+    const size_t first = upper_candle(header.count, ptime(period.begin()), time_at);
+    const size_t last = upper_candle(header.count, ptime(period.end()), time_at);
+    fxsequence seq = {minutes(header.periodicity),
+                      period_from_bin(header.period.start, header.period.end).intersection(period), {}};
+    seq.candles.reserve(last - first);
+    in.seekg(base + std::streamoff(first * sizeof(detail::fxcandle_bin)));
+    for (size_t i = first; i < last; i++) {
+        detail::fxcandle_bin candle;
+        in >> candle;
+        seq.candles.push_back(candle_from_bin(candle));
+    }
+    if (!in) {
+        throw std::ios_base::failure("Unexpected end of a sequence.");
+    }
+    return seq;
+}
+
+// Appended candles should follow the stored ones without overlapping, days of their period continue the stored period.
+void check_continuity(const detail::fxperiodicity_bin periodicity, const fxtime& period_end,
+                      const boost::posix_time::ptime& last_time, const fxsequence& seq) noexcept(false) {
+    using namespace boost::posix_time;
+    if (minutes(periodicity) != seq.periodicity) {
+        throw std::logic_error("Periodicity of appended candles does not match the stored one.");
+    }
+    const boost::gregorian::date stored_end = conversion::to_ptime(period_end).date();
+    if (seq.period.begin() != stored_end) {
+        throw std::logic_error("Appended period " + boost::gregorian::to_simple_string(seq.period) +
+                               " does not continue the stored one ending " +
+                               boost::gregorian::to_simple_string(stored_end) + ".");
+    }
+    if (!seq.candles.empty()) {
+        if (!in_period(seq.candles.front().time, seq.period) || !in_period(seq.candles.back().time, seq.period)) {
+            throw std::logic_error("Appended candles are out of their period.");
+        }
+        if (!last_time.is_special() && seq.candles.front().time <= last_time) {
+            throw std::logic_error("Appended candle time " + to_simple_string(seq.candles.front().time) +
+                                   " is less or equal the stored last time " + to_simple_string(last_time) + ".");
+        }
+    }
+}
+
+// Records are written after the last one and the header is patched.
+void append_plain(std::iostream& io, const fxsequence& seq) noexcept(false) {
     using namespace boost::posix_time;
     detail::fxsequence_header_bin header;
+    io >> header;
+    ptime last_time;
+    if (io && header.count > 0) {
+        io.seekg((header.count - 1) * sizeof(detail::fxcandle_bin), std::ios_base::cur);
+        detail::fxcandle_bin candle;
+        io >> candle;
+        last_time = conversion::to_ptime(candle.time);
+    }
+    if (!io) {
+        throw std::ios_base::failure("Unexpected end of a sequence.");
+    }
+    check_continuity(header.periodicity, header.period.end, last_time, seq);
+    io.seekp(sizeof(header) + static_cast<std::streamoff>(header.count) * sizeof(detail::fxcandle_bin));
+    for (size_t i = 0; i < seq.candles.size() && io; i++) {
+        io << candle_to_bin(seq.candles[i]);
+    }
+    header.count += static_cast<uint32_t>(seq.candles.size());
+    header.period.end = conversion::from_ptime(ptime(seq.period.end()));
+    io.seekp(0);
+    io << header;
+}
+
+// New blocks and the extended index are written past the end of the file, the header is patched the last, so an
+// interrupted append leaves the stored sequence readable. The replaced index becomes dead space. The last stored block
+// is kept as it is even when it is not full.
+void append_compressed(std::iostream& io, const fxsequence& seq) noexcept(false) {
+    using namespace boost::posix_time;
+    detail::fxsequence_header_v2_bin header;
+    io >> header;
+    std::vector<detail::fxblock_index_bin> index = read_index(io, 0, header);
+    check_continuity(header.periodicity, header.period.end,
+                     index.empty() ? ptime() : conversion::to_ptime(index.back().last), seq);
+    std::vector<detail::fxblock_header_bin> blocks;
+    std::vector<uint8_t> data;
+    encode_blocks(seq.candles, blocks, data);
+    io.seekp(0, std::ios_base::end);
+    const uint64_t offset = static_cast<uint64_t>(io.tellp());
+    write_blocks(io, offset, seq.candles, blocks, data, index);
+    for (const auto& entry : index) {
+        io << entry;
+    }
+    io.flush();
+    if (!io) {
+        throw std::ios_base::failure("Could not append candles.");
+    }
+    header.count += static_cast<uint32_t>(seq.candles.size());
+    header.period.end = conversion::from_ptime(ptime(seq.period.end()));
+    header.block_count = static_cast<uint32_t>(index.size());
+    header.index_offset = offset + blocks.size() * sizeof(detail::fxblock_header_bin) + data.size();
+    io.seekp(0);
+    io << header;
+}
+
+// Offset of the end of the sequence from the beginning of the file, a pyramid may follow it.
+uint64_t sequence_end(std::istream& in) noexcept(false) {
+    char magic[sizeof(detail::fxsequence_magic_v2)];
+    in.seekg(0);
+    in.read(magic, sizeof(magic));
+    in.seekg(0);
+    uint64_t end = 0;
+    if (in && std::memcmp(magic, detail::fxsequence_magic_v2, sizeof(magic)) == 0) {
+        detail::fxsequence_header_v2_bin header;
+        in >> header;
+        end = header.index_offset + static_cast<uint64_t>(header.block_count) * sizeof(detail::fxblock_index_bin);
+    } else {
+        detail::fxsequence_header_bin header;
+        in >> header;
+        end = sizeof(header) + static_cast<uint64_t>(header.count) * sizeof(detail::fxcandle_bin);
+    }
+    if (!in) {
+        throw std::ios_base::failure("Unexpected end of a sequence.");
+    }
+    return end;
+}
+
+// Data after the end of a sequence is accepted only when it is a pyramid.
+bool is_pyramid_at(const uint8_t* data, size_t size, uint64_t offset) {
+    return offset <= size && size - offset >= sizeof(detail::fxpyramid_magic) &&
+           std::memcmp(data + offset, detail::fxpyramid_magic, sizeof(detail::fxpyramid_magic)) == 0;
+}
+
+// Levels of the pyramid that follows the sequence, none when the file ends with the sequence.
+std::vector<detail::fxpyramid_level_bin> read_pyramid_levels(std::istream& in) noexcept(false) {
+    in.seekg(sequence_end(in));
+    detail::fxpyramid_header_bin header;
+    if (!(in >> header)) {
+        in.clear();
+        return {};
+    }
+    if (std::memcmp(header.magic, detail::fxpyramid_magic, sizeof(header.magic)) != 0) {
+        throw std::logic_error("Unknown data follows the sequence.");
+    }
+    std::vector<detail::fxpyramid_level_bin> levels(header.level_count);
+    for (auto& level : levels) {
+        in >> level;
+    }
+    if (!in) {
+        throw std::ios_base::failure("Unexpected end of a pyramid.");
+    }
+    return levels;
+}
+}  // namespace
+
+void WriteSequence(std::ostream& out, const fxsequence& seq, fxformat format) noexcept(false) {
+    using namespace boost::posix_time;
+    if (format == fxformat::fxcompressed) {
+        write_compressed(out, seq);
+        return;
+    }
+    detail::fxsequence_header_bin header;
     header.periodicity = static_cast<detail::fxperiodicity_bin>(seq.periodicity.total_seconds() / 60);
     header.count = static_cast<uint32_t>(seq.candles.size());
-    header.period.start = conversion::from_iso_string(to_iso_string(ptime(seq.period.begin())));
-    header.period.end = conversion::from_iso_string(to_iso_string(ptime(seq.period.end())));
+    header.period.start = conversion::from_ptime(ptime(seq.period.begin()));
+    header.period.end = conversion::from_ptime(ptime(seq.period.end()));
     out << header;
     for (size_t i = 0; i < seq.candles.size() && out; i++) {
-        detail::fxcandle_bin candle;
-        candle.time = conversion::from_iso_string(to_iso_string(seq.candles[i].time));
-        candle.open = static_cast<uint32_t>(seq.candles[i].open * 1e6);
-        candle.close = static_cast<uint32_t>(seq.candles[i].close * 1e6);
-        candle.high = static_cast<uint32_t>(seq.candles[i].high * 1e6);
-        candle.low = static_cast<uint32_t>(seq.candles[i].low * 1e6);
-        candle.volume = static_cast<uint16_t>(seq.candles[i].volume);
-        out << candle;
+        out << candle_to_bin(seq.candles[i]);
     }
     out.flush();
 }
 
+void AppendSequence(const std::string& filename, const fxsequence& seq) noexcept(false) {
+    uint64_t end = 0;
+    {
+        std::fstream io(filename, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        if (!io) {
+            throw std::ios_base::failure("Could not open " + filename);
+        }
+        char magic[sizeof(detail::fxsequence_magic_v2)];
+        if (!io.read(magic, sizeof(magic))) {
+            throw std::ios_base::failure("Unexpected end of a sequence.");
+        }
+        io.seekg(0);
+        if (std::memcmp(magic, detail::fxsequence_magic_v2, sizeof(magic)) == 0) {
+            append_compressed(io, seq);
+        } else {
+            append_plain(io, seq);
+        }
+        io.flush();
+        if (!io) {
+            throw std::ios_base::failure("Could not append candles to " + filename);
+        }
+        end = sequence_end(io);
+    }
+    // The rest of an overwritten pyramid of the plain format is cut off.
+    boost::filesystem::resize_file(filename, end);
+}
+
 fxsequence ReadSequence(std::istream& in) noexcept(false) {
     using namespace boost::gregorian;
     using namespace boost::posix_time;
     detail::fxsequence_header_bin header;
-    in >> header;
+    static_assert(sizeof(header) > sizeof(detail::fxsequence_magic_v2), "The magic must fit into v1 header");
+    in.read(reinterpret_cast<char*>(&header), sizeof(detail::fxsequence_magic_v2));
+    if (in && std::memcmp(&header, detail::fxsequence_magic_v2, sizeof(detail::fxsequence_magic_v2)) == 0) {
+        return read_compressed(in);
+    }
+    in.read(reinterpret_cast<char*>(&header) + sizeof(detail::fxsequence_magic_v2),
+            sizeof(header) - sizeof(detail::fxsequence_magic_v2));
     if (in) {
-        fxsequence seq = {minutes(header.periodicity),
-                          date_period(from_iso_string(conversion::to_iso_string(header.period.start)).date(),
-                                      from_iso_string(conversion::to_iso_string(header.period.end)).date()),
-                          {}};
+        fxsequence seq = {minutes(header.periodicity), period_from_bin(header.period.start, header.period.end), {}};
         seq.candles.reserve(header.count);
         for (size_t i = 0; i < header.count; i++) {
             detail::fxcandle_bin candle;
             in >> candle;
-            seq.candles.push_back({from_iso_string(conversion::to_iso_string(candle.time)),
-                                   static_cast<double>(candle.open) * 1e-6, static_cast<double>(candle.close) * 1e-6,
-                                   static_cast<double>(candle.high) * 1e-6, static_cast<double>(candle.low) * 1e-6,
-                                   candle.volume});
+            seq.candles.push_back(candle_from_bin(candle));
         }
         return seq;
     }
     return {minutes(0), date_period(date(not_a_date_time), date(not_a_date_time)), {}};
 }
 
-fxsequence PackSequence(const fxsequence& minseq, const boost::posix_time::time_duration& new_period) {
+fxsequence ReadSequence(std::istream& in, const boost::gregorian::date_period& period) noexcept(false) {
+    using namespace boost::gregorian;
     using namespace boost::posix_time;
-    if (minseq.periodicity != minutes(1)) {
-        throw std::logic_error("Wrong source sequence periodicity");
+    detail::fxsequence_header_bin header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(detail::fxsequence_magic_v2));
+    if (in && std::memcmp(&header, detail::fxsequence_magic_v2, sizeof(detail::fxsequence_magic_v2)) == 0) {
+        return read_compressed(in, period);
     }
-    if (new_period <= minseq.periodicity) {
-        throw std::logic_error("Invalid new periodicity");
+    in.read(reinterpret_cast<char*>(&header) + sizeof(detail::fxsequence_magic_v2),
+            sizeof(header) - sizeof(detail::fxsequence_magic_v2));
+    if (in) {
+        return read_plain(in, header, period);
     }
-    if (new_period.total_seconds() % 60 != 0) {
-        throw std::logic_error("Periodicity should be multiple minutes.");
+    return {minutes(0), date_period(date(not_a_date_time), date(not_a_date_time)), {}};
+}
+
+fxsequence ReadSequence(const fxsequence_view& view) {
+    fxsequence seq = {view.periodicity(), view.period(), {}};
+    seq.candles.reserve(view.size());
+    for (size_t i = 0; i < view.size(); i++) {
+        seq.candles.push_back(view[i]);
     }
-    fxsequence resseq = {new_period, minseq.period, {}};
-    if (!minseq.candles.empty()) {
-        ptime start = minseq.candles.front().time - minutes(1);  // 00:00 means last quote of previous day.
-        if (new_period < hours(1)) {
-            const auto minper = new_period.minutes();
-            if (60 % minper != 0) {
-                throw std::logic_error("Periodicity less one hour should divide hour on integer number of portions.");
+    return seq;
+}
+
+fxsequence_view::fxsequence_view(const std::string& filename) noexcept(false)
+    : fxsequence_view(filename, whole_period) {}
+
+fxsequence_view::fxsequence_view(const std::string& filename,
+                                 const boost::gregorian::date_period& period) noexcept(false)
+    : candles_(nullptr),
+      data_(nullptr),
+      cached_(0),
+      size_(0),
+      period_(boost::gregorian::date(), boost::gregorian::date()) {
+    using namespace boost::posix_time;
+    auto file = std::make_shared<boost::iostreams::mapped_file_source>(filename);
+    const uint8_t* const data = reinterpret_cast<const uint8_t*>(file->data());
+    if (file->size() >= sizeof(detail::fxsequence_magic_v2) &&
+        std::memcmp(data, detail::fxsequence_magic_v2, sizeof(detail::fxsequence_magic_v2)) == 0) {
+        // Only blocks of the period are referenced, blocks at its edges are decoded to count their candles in it.
+        detail::fxsequence_header_v2_bin header;
+        if (file->size() < sizeof(header)) {
+            throw std::logic_error("The file '" + filename + "' is too small to be a quote sequence.");
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.index_offset > file->size() ||
+            (file->size() - header.index_offset) / sizeof(detail::fxblock_index_bin) < header.block_count) {
+            throw std::logic_error("The file '" + filename + "' is truncated.");
+        }
+        for (uint32_t b = 0; b < header.block_count; b++) {
+            detail::fxblock_index_bin entry;
+            std::memcpy(&entry, data + header.index_offset + b * sizeof(entry), sizeof(entry));
+            if (conversion::to_ptime(entry.last) <= ptime(period.begin()) ||
+                conversion::to_ptime(entry.first) > ptime(period.end())) {
+                continue;
             }
-            time_duration time = start.time_of_day();
-            auto mins = (time.minutes() / minper) * minper;
-            start = ptime(start.date(), time_duration(time.hours(), mins, 0));
-        } else if (new_period < hours(24)) {
-            if (new_period.total_seconds() % 3600 != 0) {
-                throw std::logic_error("Periodicity should be multiple hours.");
+            detail::fxblock_header_bin block;
+            if (entry.offset > header.index_offset || header.index_offset - entry.offset < sizeof(block)) {
+                throw std::logic_error("The file '" + filename + "' is truncated.");
             }
-            const auto hper = new_period.hours();
-            if (24 % hper != 0) {
-                throw std::logic_error("Periodicity less one day should divide 24h on integer number of portions.");
+            std::memcpy(&block, data + entry.offset, sizeof(block));
+            if (header.index_offset - entry.offset - sizeof(block) < block.size || block.count != entry.count) {
+                throw std::logic_error("The file '" + filename + "' is truncated.");
             }
-            time_duration time = start.time_of_day();
-            auto hs = (time.hours() / hper) * hper;
-            start = ptime(start.date(), time_duration(hs, 0, 0));
-        } else {
-            throw std::logic_error("Not inplemented!");
+            block_ref ref = {entry.offset, size_, 0};
+            size_t count = entry.count;
+            if (conversion::to_ptime(entry.first) <= ptime(period.begin()) ||
+                conversion::to_ptime(entry.last) > ptime(period.end())) {
+                cache_.clear();
+                decode_block(block, data + entry.offset + sizeof(block), cache_);
+                const auto time_at = [this](size_t idx) { return cache_[idx].time; };
+                ref.skip = upper_candle(cache_.size(), ptime(period.begin()), time_at);
+                count = upper_candle(cache_.size(), ptime(period.end()), time_at) - ref.skip;
+            }
+            if (count > 0) {
+                blocks_.push_back(ref);
+                size_ += count;
+            }
+        }
+        cache_.clear();
+        cached_ = blocks_.size();
+        data_ = data;
+        periodicity_ = minutes(header.periodicity);
+        period_ = period_from_bin(header.period.start, header.period.end).intersection(period);
+        file_ = file;
+        return;
+    }
+    if (file->size() < sizeof(detail::fxsequence_header_bin)) {
+        throw std::logic_error("The file '" + filename + "' is too small to be a quote sequence.");
+    }
+    detail::fxsequence_header_bin header;
+    std::memcpy(&header, data, sizeof(header));
+    const uint64_t end = sizeof(header) + static_cast<uint64_t>(header.count) * sizeof(detail::fxcandle_bin);
+    if (file->size() != end && !is_pyramid_at(data, file->size(), end)) {
+        throw std::logic_error("The size of file '" + filename + "' does not match its header.");
+    }
+    const auto candles = reinterpret_cast<const detail::fxcandle_bin*>(data + sizeof(header));
+    const auto time_at = [candles](size_t idx) { return conversion::to_ptime(candles[idx].time); };
+    const size_t first = upper_candle(header.count, ptime(period.begin()), time_at);
+    const size_t last = upper_candle(header.count, ptime(period.end()), time_at);
+    candles_ = candles + first;
+    size_ = last - first;
+    periodicity_ = minutes(header.periodicity);
+    period_ = period_from_bin(header.period.start, header.period.end).intersection(period);
+    file_ = file;
+}
+
+fxcandle fxsequence_view::operator[](size_t idx) const {
+    return candles_ ? candle_from_bin(candles_[idx]) : decoded(idx);
+}
+
+const fxcandle& fxsequence_view::decoded(size_t idx) const {
+    const auto block_end = [this](size_t b) { return b + 1 < blocks_.size() ? blocks_[b + 1].first : size_; };
+    if (cached_ == blocks_.size() || idx < blocks_[cached_].first || idx >= block_end(cached_)) {
+        const auto next = std::upper_bound(blocks_.begin(), blocks_.end(), idx,
+                                           [](size_t i, const block_ref& ref) { return i < ref.first; });
+        cached_ = static_cast<size_t>(next - blocks_.begin()) - 1;
+        detail::fxblock_header_bin block;
+        std::memcpy(&block, data_ + blocks_[cached_].offset, sizeof(block));
+        cache_.clear();
+        decode_block(block, data_ + blocks_[cached_].offset + sizeof(block), cache_);
+        // The candles before the view are dropped, so the cache is indexed from the first candle of the block in it.
+        cache_.erase(cache_.begin(), cache_.begin() + blocks_[cached_].skip);
+    }
+    return cache_[idx - blocks_[cached_].first];
+}
+
+fxcandle fxsequence_view::at(size_t idx) const noexcept(false) {
+    if (idx >= size_) {
+        throw std::out_of_range("Candle index is out of the sequence view.");
+    }
+    return (*this)[idx];
+}
+
+fxsequence_reader::fxsequence_reader(const std::string& filename, size_t batch_size) noexcept(false)
+    : fxsequence_reader(filename, whole_period, batch_size) {}
+
+fxsequence_reader::fxsequence_reader(const std::string& filename, const boost::gregorian::date_period& period,
+                                     size_t batch_size) noexcept(false)
+    : in_(new std::ifstream(filename, std::ifstream::binary)),
+      compressed_(false),
+      batch_size_(std::max<size_t>(batch_size, 1)),
+      selection_(period),
+      first_(0),
+      next_(0),
+      size_(0),
+      period_(boost::gregorian::date(), boost::gregorian::date()) {
+    using namespace boost::posix_time;
+    if (!*in_) {
+        throw std::ios_base::failure("Could not open '" + filename + "'");
+    }
+    char magic[sizeof(detail::fxsequence_magic_v2)];
+    in_->read(magic, sizeof(magic));
+    in_->seekg(0);
+    if (in_->gcount() == sizeof(magic) && std::memcmp(magic, detail::fxsequence_magic_v2, sizeof(magic)) == 0) {
+        compressed_ = true;
+        detail::fxsequence_header_v2_bin header;
+        *in_ >> header;
+        in_->seekg(header.index_offset);
+        for (uint32_t b = 0; b < header.block_count; b++) {
+            detail::fxblock_index_bin entry;
+            *in_ >> entry;
+            if (conversion::to_ptime(entry.last) > ptime(period.begin()) &&
+                conversion::to_ptime(entry.first) <= ptime(period.end())) {
+                blocks_.push_back(entry);
+            }
+        }
+        if (!*in_) {
+            throw std::logic_error("The file '" + filename + "' is truncated.");
         }
-        time_iterator titr(start, new_period);
-        for (auto iter = minseq.candles.cbegin(); iter < minseq.candles.cend(); ++iter) {
-            if (iter->time > *titr) {
-                while (iter->time > *titr) {
-                    ++titr;
+        periodicity_ = minutes(header.periodicity);
+        period_ = period_from_bin(header.period.start, header.period.end).intersection(period);
+        // Blocks at the edges may be partly out of the period.
+        std::vector<fxcandle> candles;
+        for (size_t b = 0; b < blocks_.size(); b++) {
+            if (b == 0 || b + 1 == blocks_.size()) {
+                read_block(blocks_[b], candles);
+                size_ += candles.size();
+                if (!candles.empty()) {
+                    last_time_ = candles.back().time;
                 }
-                resseq.candles.push_back({*titr, iter->open, iter->close, iter->high, iter->low, iter->volume});
-                continue;
+            } else {
+                size_ += blocks_[b].count;
+                last_time_ = conversion::to_ptime(blocks_[b].last);
             }
-            fxcandle& curr = resseq.candles.back();
-            curr.close = iter->close;
-            curr.high = std::max(curr.high, iter->high);
-            curr.low = std::min(curr.low, iter->low);
-            curr.volume += iter->volume;
         }
+        return;
+    }
+    detail::fxsequence_header_bin header;
+    *in_ >> header;
+    if (!*in_) {
+        throw std::logic_error("The file '" + filename + "' is too small to be a quote sequence.");
+    }
+    const auto time_at = [this](size_t idx) {
+        in_->seekg(sizeof(detail::fxsequence_header_bin) + idx * sizeof(detail::fxcandle_bin));
+        fxtime time;
+        *in_ >> time.data;
+        if (!*in_) {
+            throw std::ios_base::failure("Unexpected end of a sequence.");
+        }
+        return conversion::to_ptime(time);
+    };
+    first_ = upper_candle(header.count, ptime(period.begin()), time_at);
+    size_ = upper_candle(header.count, ptime(period.end()), time_at) - first_;
+    if (size_ > 0) {
+        last_time_ = time_at(first_ + size_ - 1);
+    }
+    periodicity_ = minutes(header.periodicity);
+    period_ = period_from_bin(header.period.start, header.period.end).intersection(period);
+}
+
+fxsequence_reader::fxsequence_reader(fxsequence_reader&& other) = default;
+fxsequence_reader& fxsequence_reader::operator=(fxsequence_reader&& other) = default;
+fxsequence_reader::~fxsequence_reader() = default;
+
+bool fxsequence_reader::next_batch(std::vector<fxcandle>& batch) noexcept(false) {
+    return next_batch_of(batch);
+}
+
+bool fxsequence_reader::next_batch(std::vector<fxminute_candle>& batch) noexcept(false) {
+    return next_batch_of(batch);
+}
+
+template <typename Candle>
+bool fxsequence_reader::next_batch_of(std::vector<Candle>& batch) noexcept(false) {
+    batch.clear();
+    if (compressed_) {
+        while (batch.empty() && next_ < blocks_.size()) {
+            read_block(blocks_[next_++], batch);
+        }
+        return !batch.empty();
+    }
+    const size_t count = std::min(batch_size_, size_ - next_);
+    if (count == 0) {
+        return false;
+    }
+    in_->seekg(sizeof(detail::fxsequence_header_bin) + (first_ + next_) * sizeof(detail::fxcandle_bin));
+    batch.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        detail::fxcandle_bin candle;
+        *in_ >> candle;
+        candle_from_bin(candle, batch[i]);
+    }
+    if (!*in_) {
+        throw std::ios_base::failure("Unexpected end of a sequence.");
+    }
+    next_ += count;
+    return true;
+}
+
+template <typename Candle>
+void fxsequence_reader::read_block(const detail::fxblock_index_bin& entry,
+                                   std::vector<Candle>& candles) noexcept(false) {
+    using boost::posix_time::ptime;
+    in_->seekg(entry.offset);
+    detail::fxblock_header_bin block;
+    *in_ >> block;
+    data_.resize(block.size);
+    in_->read(reinterpret_cast<char*>(data_.data()), block.size);
+    if (!*in_ || block.count != entry.count) {
+        throw std::ios_base::failure("Unexpected end of a compressed sequence.");
+    }
+    candles.clear();
+    decode_block(block, data_.data(), candles);
+    // Only a block at the edge of the selection has candles out of it.
+    if (conversion::to_ptime(entry.first) <= ptime(selection_.begin()) ||
+        conversion::to_ptime(entry.last) > ptime(selection_.end())) {
+        const fxminutes begin = ToEpochMinutes(ptime(selection_.begin()));
+        const fxminutes end = ToEpochMinutes(ptime(selection_.end()));
+        const auto out_of_period = [begin, end](const Candle& c) {
+            const fxminutes time = candle_minutes(c);
+            return time <= begin || time > end;
+        };
+        candles.erase(std::remove_if(candles.begin(), candles.end(), out_of_period), candles.end());
+    }
+}
+
+namespace {
+// Partitions are not split below this number of candles, a thread costs more than packing of a smaller range.
+const size_t fxMinPackPartition = 1 << 15;
+
+// Packing of the minute candles [first, last), the first candle opens a bucket.
+void pack_range(const std::vector<fxcandle>& candles, const fxbuckets& buckets, size_t first, size_t last,
+                std::vector<fxcandle>& packed) {
+    for (size_t i = first; i < last; i++) {
+        const fxcandle& candle = candles[i];
+        // The time of the packed candle is the end of its bucket.
+        if (i == first || candle.time > packed.back().time) {
+            packed.push_back({buckets.end_time(buckets.index(candle.time)), candle.open, candle.close, candle.high,
+                              candle.low, candle.volume});
+            continue;
+        }
+        fxcandle& curr = packed.back();
+        curr.close = candle.close;
+        curr.high = std::max(curr.high, candle.high);
+        curr.low = std::min(curr.low, candle.low);
+        curr.volume += candle.volume;
+    }
+}
+}  // namespace
+
+namespace detail {
+
+fxbuckets pack_buckets(const boost::posix_time::time_duration& new_period) noexcept(false) {
+    if (new_period <= boost::posix_time::minutes(1)) {
+        throw std::logic_error("Invalid new periodicity");
+    }
+    return fxbuckets(new_period);
+}
+
+std::vector<size_t> pack_bounds(size_t count, unsigned jobs, const std::function<int64_t(size_t)>& bucket) {
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t parts = std::max<size_t>(1, std::min<size_t>(jobs, count / fxMinPackPartition));
+    // Partitions begin at bucket boundaries, so no bucket is shared between two threads.
+    std::vector<size_t> bounds{0};
+    for (size_t p = 1; p < parts; p++) {
+        size_t idx = std::max(bounds.back(), p * count / parts);
+        while (idx > 0 && idx < count && bucket(idx) == bucket(idx - 1)) {
+            idx++;
+        }
+        bounds.push_back(idx);
+    }
+    bounds.push_back(count);
+    return bounds;
+}
+
+void pack_parts(size_t parts, const std::function<void(size_t)>& pack) {
+    // An exception of a part is rethrown after all the threads are joined.
+    std::vector<std::exception_ptr> errors(parts);
+    const auto pack_part = [&](size_t p) {
+        try {
+            pack(p);
+        } catch (...) {
+            errors[p] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t p = 1; p < parts; p++) {
+        pool.emplace_back(pack_part, p);
+    }
+    pack_part(0);
+    for (auto& worker : pool) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+}  // namespace detail
+
+fxsequence PackSequence(const fxsequence& minseq, const boost::posix_time::time_duration& new_period, unsigned jobs) {
+    using namespace boost::posix_time;
+    if (minseq.periodicity != minutes(1)) {
+        throw std::logic_error("Wrong source sequence periodicity");
+    }
+    const fxbuckets buckets = detail::pack_buckets(new_period);
+    const auto& candles = minseq.candles;
+    const std::vector<size_t> bounds =
+        detail::pack_bounds(candles.size(), jobs, [&](size_t i) { return buckets.index(candles[i].time); });
+    std::vector<std::vector<fxcandle>> packs(bounds.size() - 1);
+    detail::pack_parts(packs.size(),
+                       [&](size_t p) { pack_range(candles, buckets, bounds[p], bounds[p + 1], packs[p]); });
+    fxsequence resseq = {new_period, minseq.period, std::move(packs[0])};
+    for (size_t p = 1; p < packs.size(); p++) {
+        resseq.candles.insert(resseq.candles.end(), packs[p].begin(), packs[p].end());
     }
     return resseq;
 }
 
+fxresampler::fxresampler(const std::vector<boost::posix_time::time_duration>& periods,
+                         callback on_candle) noexcept(false)
+    : on_candle_(std::move(on_candle)), started_(false) {
+    for (const auto& period : periods) {
+        levels_.push_back({fxbuckets(period), fxcandle{}});
+    }
+}
+
+const fxcandle& fxresampler::current(size_t level) const noexcept(false) {
+    if (!started_) {
+        throw std::logic_error("No candle has been pushed into the resampler.");
+    }
+    return levels_.at(level).candle;
+}
+
+void fxresampler::push(const fxcandle& candle) noexcept(false) {
+    if (started_ && candle.time <= last_time_) {
+        throw std::logic_error("Candles should be pushed in time order.");
+    }
+    for (auto& l : levels_) {
+        fxcandle& curr = l.candle;
+        if (started_ && candle.time <= curr.time) {
+            curr.close = candle.close;
+            curr.high = std::max(curr.high, candle.high);
+            curr.low = std::min(curr.low, candle.low);
+            curr.volume += candle.volume;
+            continue;
+        }
+        if (started_) {
+            on_candle_(l.buckets.period(), curr);
+        }
+        curr = candle;
+        curr.time = l.buckets.end_time(l.buckets.index(candle.time));
+    }
+    started_ = true;
+    last_time_ = candle.time;
+}
+
+void fxresampler::flush() {
+    if (started_) {
+        for (const auto& l : levels_) {
+            on_candle_(l.buckets.period(), l.candle);
+        }
+    }
+    reset();
+}
+
+void fxresampler::reset() {
+    started_ = false;
+}
+
+std::vector<boost::posix_time::time_duration> fxpyramid::default_periods() {
+    using namespace boost::posix_time;
+    return {minutes(5), minutes(15), minutes(30), hours(1), hours(4)};
+}
+
+fxpyramid::fxpyramid(const fxsequence& minseq,
+                     const std::vector<boost::posix_time::time_duration>& periods) noexcept(false) {
+    if (minseq.periodicity != boost::posix_time::minutes(1)) {
+        throw std::logic_error("Wrong source sequence periodicity");
+    }
+    pack(minseq.period, periods, [&minseq](fxresampler& resampler) {
+        for (const auto& candle : minseq.candles) {
+            resampler.push(candle);
+        }
+    });
+}
+
+fxpyramid::fxpyramid(fxsequence_reader& reader,
+                     const std::vector<boost::posix_time::time_duration>& periods) noexcept(false) {
+    if (reader.periodicity() != boost::posix_time::minutes(1)) {
+        throw std::logic_error("Wrong source sequence periodicity");
+    }
+    pack(reader.period(), periods, [&reader](fxresampler& resampler) {
+        reader.rewind();
+        std::vector<fxcandle> batch;
+        while (reader.next_batch(batch)) {
+            for (const auto& candle : batch) {
+                resampler.push(candle);
+            }
+        }
+    });
+}
+
+void fxpyramid::pack(const boost::gregorian::date_period& period,
+                     const std::vector<boost::posix_time::time_duration>& periods,
+                     const std::function<void(fxresampler&)>& feed) noexcept(false) {
+    using namespace boost::posix_time;
+    for (const auto& p : periods) {
+        if (p <= minutes(1)) {
+            throw std::logic_error("Invalid new periodicity");
+        }
+        add({p, period, {}});
+    }
+    // All levels are packed by a single pass.
+    fxresampler resampler(periods, [this](const time_duration& p, const fxcandle& candle) {
+        levels_[index_.at(ToMinutes(p))].candles.push_back(candle);
+    });
+    feed(resampler);
+    resampler.flush();
+}
+
+const fxsequence* fxpyramid::find(const boost::posix_time::time_duration& period) const {
+    const auto it = index_.find(ToMinutes(period));
+    return it != index_.end() && levels_[it->second].periodicity == period ? &levels_[it->second] : nullptr;
+}
+
+const fxsequence& fxpyramid::level(const boost::posix_time::time_duration& period) const noexcept(false) {
+    const fxsequence* level = find(period);
+    if (level == nullptr) {
+        throw std::out_of_range("No level of " + boost::posix_time::to_simple_string(period) + " in the pyramid.");
+    }
+    return *level;
+}
+
+void fxpyramid::add(fxsequence level) noexcept(false) {
+    if (!index_.emplace(ToMinutes(level.periodicity), levels_.size()).second) {
+        throw std::logic_error("The pyramid has a level of " + boost::posix_time::to_simple_string(level.periodicity) +
+                               " already.");
+    }
+    levels_.push_back(std::move(level));
+}
+
+void WritePyramid(const std::string& filename, const fxpyramid& pyramid) noexcept(false) {
+    uint64_t end = 0;
+    {
+        std::fstream io(filename, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        if (!io) {
+            throw std::ios_base::failure("Could not open " + filename);
+        }
+        end = sequence_end(io);
+        if (!pyramid.empty()) {
+            std::vector<std::string> levels;
+            for (size_t i = 0; i < pyramid.size(); i++) {
+                std::ostringstream level(std::ios_base::binary);
+                write_compressed(level, pyramid[i], true);
+                levels.push_back(level.str());
+            }
+            detail::fxpyramid_header_bin header;
+            std::memcpy(header.magic, detail::fxpyramid_magic, sizeof(header.magic));
+            header.level_count = static_cast<uint32_t>(levels.size());
+            io.seekp(end);
+            io << header;
+            end += sizeof(header) + levels.size() * sizeof(detail::fxpyramid_level_bin);
+            for (size_t i = 0; i < levels.size(); i++) {
+                io << detail::fxpyramid_level_bin{
+                    static_cast<detail::fxperiodicity_bin>(pyramid[i].periodicity.total_seconds() / 60), end,
+                    levels[i].size()};
+                end += levels[i].size();
+            }
+            for (const auto& level : levels) {
+                io.write(level.data(), level.size());
+            }
+            io.flush();
+            if (!io) {
+                throw std::ios_base::failure("Could not write the pyramid to " + filename);
+            }
+        }
+    }
+    // The rest of a longer pyramid is cut off.
+    boost::filesystem::resize_file(filename, end);
+}
+
+std::vector<boost::posix_time::time_duration> ReadPyramidPeriods(const std::string& filename) noexcept(false) {
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in) {
+        throw std::ios_base::failure("Could not open '" + filename + "'");
+    }
+    std::vector<boost::posix_time::time_duration> periods;
+    for (const auto& level : read_pyramid_levels(in)) {
+        periods.push_back(boost::posix_time::minutes(level.periodicity));
+    }
+    return periods;
+}
+
+fxpyramid ReadPyramid(const std::string& filename) noexcept(false) {
+    return ReadPyramid(filename, whole_period);
+}
+
+fxpyramid ReadPyramid(const std::string& filename, const boost::gregorian::date_period& period) noexcept(false) {
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in) {
+        throw std::ios_base::failure("Could not open '" + filename + "'");
+    }
+    fxpyramid pyramid;
+    for (const auto& level : read_pyramid_levels(in)) {
+        in.seekg(level.offset);
+        pyramid.add(ReadSequence(in, period));
+        if (!in) {
+            throw std::ios_base::failure("Unexpected end of a pyramid.");
+        }
+    }
+    return pyramid;
+}
+
 }  // namespace fxlib
@@ -1,12 +1,26 @@
 #pragma once
 
+#include "fxtime.h"
+
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace fxlib {
 
+namespace detail {
+struct fxcandle_bin;
+struct fxblock_index_bin;
+}  // namespace detail
+
 struct fxcandle {
     boost::posix_time::ptime time;
     double open;
@@ -34,6 +48,28 @@ static inline double fxprofit_short(const fxcandle& close, const fxcandle& open)
 
 using fprofit_t = double (*)(const fxlib::fxcandle& /*close*/, const fxlib::fxcandle& /*open*/);
 
+// The candle with compact time in epoch minutes for hot loops, the same fields as fxcandle.
+struct fxminute_candle {
+    fxminutes time;
+    double open;
+    double close;
+    double high;
+    double low;
+    size_t volume;
+};
+
+static inline double fxmean(const fxminute_candle& c) {
+    return (c.open + c.close) / 2.0;
+}
+
+static inline fxminute_candle ToMinuteCandle(const fxcandle& c) noexcept(false) {
+    return {ToEpochMinutes(c.time), c.open, c.close, c.high, c.low, c.volume};
+}
+
+static inline fxcandle FromMinuteCandle(const fxminute_candle& c) noexcept {
+    return {FromEpochMinutes(c.time), c.open, c.close, c.high, c.low, c.volume};
+}
+
 // enum class fxperiodicity : int {
 //  tick = 0,
 //  minutely = 1,
@@ -52,9 +88,350 @@ struct fxsequence {
     std::vector<fxcandle> candles;
 };
 
-// Binary writing/reading quote sequence into a stream.
-void WriteSequence(std::ostream& out, const fxsequence& seq) noexcept(false);
+// Layout of a compiled (binary) quote file.
+enum class fxformat {
+    fxplain,       // v1: fixed-size records
+    fxcompressed,  // v2: delta encoded blocks of candles with block index
+};
+
+/// Read-only random access to a compiled (binary) quote file.
+/**
+  The file is mapped into memory instead of being read, candles are decoded one by one only when they are accessed.
+  Thus opening a view costs the same for any size of the file and no copy of the data is made.
+  Copies of a view share the same mapping.
+  Compressed files cannot be accessed by candles in place: opening reads the block index and a block is decoded when
+  one of its candles is accessed. The last decoded block is kept by the view, so a sequential access decodes every
+  block once and the memory is that of one block, but a view of a compressed file should not be shared by threads.
+*/
+class fxsequence_view {
+ public:
+    class const_iterator;
+
+    explicit fxsequence_view(const std::string& filename) noexcept(false);
+    // Only candles of days of the period are accessible, see ReadSequence(in, period).
+    fxsequence_view(const std::string& filename, const boost::gregorian::date_period& period) noexcept(false);
+
+    const boost::posix_time::time_duration& periodicity() const {
+        return periodicity_;
+    }
+    const boost::gregorian::date_period& period() const {
+        return period_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    fxcandle operator[](size_t idx) const;
+    fxcandle at(size_t idx) const noexcept(false);
+    fxcandle front() const {
+        return (*this)[0];
+    }
+    fxcandle back() const {
+        return (*this)[size_ - 1];
+    }
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+ private:
+    // Block of a compressed file: the offset of its header, the index of its first candle in the view and the number
+    // of its candles before the view.
+    struct block_ref {
+        uint64_t offset;
+        size_t first;
+        size_t skip;
+    };
+
+    const fxcandle& decoded(size_t idx) const;
+
+    std::shared_ptr<const void> file_;
+    const detail::fxcandle_bin* candles_;  // plain file
+    const uint8_t* data_;                  // compressed file
+    std::vector<block_ref> blocks_;
+    mutable size_t cached_;  // index of the decoded block, blocks_.size() when there is no one
+    mutable std::vector<fxcandle> cache_;
+    size_t size_;
+    boost::posix_time::time_duration periodicity_;
+    boost::gregorian::date_period period_;
+};
+
+/// Random access iterator over a view, dereferencing returns a decoded candle by value.
+class fxsequence_view::const_iterator {
+ public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = fxcandle;
+    using difference_type = std::ptrdiff_t;
+    using reference = fxcandle;
+    struct pointer {
+        const fxcandle* operator->() const {
+            return &candle;
+        }
+        fxcandle candle;
+    };
+
+    const_iterator() : view_(nullptr), idx_(0) {}
+    const_iterator(const fxsequence_view* view, size_t idx) : view_(view), idx_(idx) {}
+
+    reference operator*() const {
+        return (*view_)[idx_];
+    }
+    pointer operator->() const {
+        return {(*view_)[idx_]};
+    }
+    reference operator[](difference_type n) const {
+        return (*view_)[idx_ + n];
+    }
+
+    const_iterator& operator++() {
+        ++idx_;
+        return *this;
+    }
+    const_iterator operator++(int) {
+        return const_iterator(view_, idx_++);
+    }
+    const_iterator& operator--() {
+        --idx_;
+        return *this;
+    }
+    const_iterator operator--(int) {
+        return const_iterator(view_, idx_--);
+    }
+    const_iterator& operator+=(difference_type n) {
+        idx_ += n;
+        return *this;
+    }
+    const_iterator& operator-=(difference_type n) {
+        idx_ -= n;
+        return *this;
+    }
+    const_iterator operator+(difference_type n) const {
+        return const_iterator(view_, idx_ + n);
+    }
+    const_iterator operator-(difference_type n) const {
+        return const_iterator(view_, idx_ - n);
+    }
+    difference_type operator-(const const_iterator& other) const {
+        return static_cast<difference_type>(idx_) - static_cast<difference_type>(other.idx_);
+    }
+
+    bool operator==(const const_iterator& other) const {
+        return idx_ == other.idx_;
+    }
+    bool operator!=(const const_iterator& other) const {
+        return idx_ != other.idx_;
+    }
+    bool operator<(const const_iterator& other) const {
+        return idx_ < other.idx_;
+    }
+    bool operator>(const const_iterator& other) const {
+        return idx_ > other.idx_;
+    }
+    bool operator<=(const const_iterator& other) const {
+        return idx_ <= other.idx_;
+    }
+    bool operator>=(const const_iterator& other) const {
+        return idx_ >= other.idx_;
+    }
+
+ private:
+    const fxsequence_view* view_;
+    size_t idx_;
+};
+
+inline fxsequence_view::const_iterator fxsequence_view::begin() const {
+    return const_iterator(this, 0);
+}
+
+inline fxsequence_view::const_iterator fxsequence_view::end() const {
+    return const_iterator(this, size_);
+}
+
+/// Sequential reading of a compiled (binary) quote file by batches of candles.
+/**
+  Only the current batch is decoded, so a file of any length is processed in constant memory.
+  A plain file is read by batch_size candles, a compressed one by its blocks.
+*/
+class fxsequence_reader {
+ public:
+    explicit fxsequence_reader(const std::string& filename, size_t batch_size = 1440) noexcept(false);
+    // Only candles of days of the period are read, see ReadSequence(in, period).
+    fxsequence_reader(const std::string& filename, const boost::gregorian::date_period& period,
+                      size_t batch_size = 1440) noexcept(false);
+    fxsequence_reader(fxsequence_reader&& other);
+    fxsequence_reader& operator=(fxsequence_reader&& other);
+    ~fxsequence_reader();
+
+    const boost::posix_time::time_duration& periodicity() const {
+        return periodicity_;
+    }
+    const boost::gregorian::date_period& period() const {
+        return period_;
+    }
+    // Number of candles to be read in total.
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    // Time of the last candle to be read.
+    const boost::posix_time::ptime& last_time() const {
+        return last_time_;
+    }
+    fxformat format() const {
+        return compressed_ ? fxformat::fxcompressed : fxformat::fxplain;
+    }
+
+    // Replaces content of the batch with the next candles, returns false when all candles have been read.
+    bool next_batch(std::vector<fxcandle>& batch) noexcept(false);
+    // The same batches with times decoded straight into epoch minutes.
+    bool next_batch(std::vector<fxminute_candle>& batch) noexcept(false);
+    // Reading starts over from the first candle.
+    void rewind() {
+        next_ = 0;
+    }
+
+ private:
+    template <typename Candle>
+    bool next_batch_of(std::vector<Candle>& batch) noexcept(false);
+    template <typename Candle>
+    void read_block(const detail::fxblock_index_bin& entry, std::vector<Candle>& candles) noexcept(false);
+
+    std::unique_ptr<std::istream> in_;
+    bool compressed_;
+    size_t batch_size_;
+    boost::gregorian::date_period selection_;
+    // Plain file: records [first_, first_ + size_), compressed file: blocks_ overlapping the selection.
+    size_t first_;
+    std::vector<detail::fxblock_index_bin> blocks_;
+    size_t next_;  // candle or block to be read
+    std::vector<uint8_t> data_;
+    size_t size_;
+    boost::posix_time::ptime last_time_;
+    boost::posix_time::time_duration periodicity_;
+    boost::gregorian::date_period period_;
+};
+
+// Binary writing/reading quote sequence into a stream, reading detects the format itself.
+void WriteSequence(std::ostream& out, const fxsequence& seq, fxformat format = fxformat::fxplain) noexcept(false);
 fxsequence ReadSequence(std::istream& in) noexcept(false);
+// Extending a compiled file in place by candles that continue it: the period of the sequence should begin at the end of
+// the stored period. Only the new candles are written and the header is patched, the format of the file is kept. A
+// stored pyramid is removed since it does not cover the new candles. The compressed format gets the new blocks and the
+// extended index at the end of the file before the header is patched, so an interrupted append keeps the file
+// readable; the replaced index and pyramid are left as dead space.
+void AppendSequence(const std::string& filename, const fxsequence& seq) noexcept(false);
+// Reading only candles of days of the period (the 00:00 candle belongs to the previous day), the stream should be
+// seekable. The compressed format uses its block index, the plain one is searched in binary.
+fxsequence ReadSequence(std::istream& in, const boost::gregorian::date_period& period) noexcept(false);
+// Decoding all candles of a mapped file into a sequence.
+fxsequence ReadSequence(const fxsequence_view& view);
+
+/// Packing of minute quotes into candles of new_period.
+/**
+  Candles of a long sequence are split at bucket boundaries into partitions that are packed by jobs threads (0 means
+  the number of hardware threads), the candles are expected in order of time.
+*/
+fxsequence PackSequence(const fxsequence& min_seq, const boost::posix_time::time_duration& new_period,
+                        unsigned jobs = 0);
+
+/// Incremental aggregation of minute candles into candles of several longer periods at once.
+/**
+  Candles are pushed one by one in time order. A candle of a period is completed when a pushed one falls into a later
+  bucket (see fxbuckets), then it is passed to the callback. Every push does a constant work per period and the
+  completed candles are the same as PackSequence makes, the candles being aggregated are emitted by flush().
+*/
+class fxresampler {
+ public:
+    using callback = std::function<void(const boost::posix_time::time_duration& /*period*/, const fxcandle&)>;
+
+    fxresampler(const std::vector<boost::posix_time::time_duration>& periods, callback on_candle) noexcept(false);
+
+    size_t size() const {
+        return levels_.size();
+    }
+    boost::posix_time::time_duration period(size_t level) const {
+        return levels_[level].buckets.period();
+    }
+    // The candle of the period being aggregated, a candle should be pushed since the reset.
+    const fxcandle& current(size_t level) const noexcept(false);
+
+    void push(const fxcandle& candle) noexcept(false);
+    // Emitting the candles being aggregated as if they were completed and starting over.
+    void flush();
+    // Dropping the candles being aggregated.
+    void reset();
+
+ private:
+    struct level {
+        fxbuckets buckets;
+        fxcandle candle;  // its time is the end of the bucket
+    };
+
+    std::vector<level> levels_;
+    callback on_candle_;
+    bool started_;
+    boost::posix_time::ptime last_time_;
+};
+
+/// Sequences of several longer periods packed from minute quotes, the levels of the pyramid.
+/**
+  Every level is the same as PackSequence makes and it is found by its period in a constant time. The pyramid is
+  stored after the minute quotes of a compiled file (see WritePyramid), so the packing is done once when the file is
+  compiled instead of every run that needs the same period.
+*/
+class fxpyramid {
+ public:
+    // 5m, 15m, 30m, 1h and 4h.
+    static std::vector<boost::posix_time::time_duration> default_periods();
+
+    fxpyramid() = default;
+    fxpyramid(const fxsequence& minseq, const std::vector<boost::posix_time::time_duration>& periods) noexcept(false);
+    // Packing the minute quotes of a compiled file as they are stored, the reader is read from its first candle.
+    fxpyramid(fxsequence_reader& reader, const std::vector<boost::posix_time::time_duration>& periods) noexcept(false);
+
+    size_t size() const {
+        return levels_.size();
+    }
+    bool empty() const {
+        return levels_.empty();
+    }
+    const fxsequence& operator[](size_t idx) const {
+        return levels_[idx];
+    }
+    // The level of the period, nullptr when the period has not been packed.
+    const fxsequence* find(const boost::posix_time::time_duration& period) const;
+    const fxsequence& level(const boost::posix_time::time_duration& period) const noexcept(false);
+    // The period of the level should not be in the pyramid yet.
+    void add(fxsequence level) noexcept(false);
+
+ private:
+    // Levels of the periods are packed by a single pass, feed() pushes the minute candles into the resampler.
+    void pack(const boost::gregorian::date_period& period, const std::vector<boost::posix_time::time_duration>& periods,
+              const std::function<void(fxresampler&)>& feed) noexcept(false);
+
+    std::vector<fxsequence> levels_;
+    std::unordered_map<fxminutes, size_t> index_;  // level by its period in minutes
+};
+
+// Storing the pyramid after the sequence of a compiled file, a stored pyramid is replaced, an empty one is removed.
+void WritePyramid(const std::string& filename, const fxpyramid& pyramid) noexcept(false);
+// Periods of the pyramid stored in the file, empty when the file has no pyramid.
+std::vector<boost::posix_time::time_duration> ReadPyramidPeriods(const std::string& filename) noexcept(false);
+fxpyramid ReadPyramid(const std::string& filename) noexcept(false);
+// Reading only candles of days of the period, see ReadSequence(in, period).
+fxpyramid ReadPyramid(const std::string& filename, const boost::gregorian::date_period& period) noexcept(false);
 
-fxsequence PackSequence(const fxsequence& min_seq, const boost::posix_time::time_duration& new_period);
+namespace detail {
+// Buckets of packed candles, the new period should be longer than a minute.
+fxbuckets pack_buckets(const boost::posix_time::time_duration& new_period) noexcept(false);
+// Bounds of partitions of count candles for jobs threads (0 means the number of hardware threads), a partition begins
+// at a boundary of buckets given by the bucket index of a candle.
+std::vector<size_t> pack_bounds(size_t count, unsigned jobs, const std::function<int64_t(size_t)>& bucket);
+// Packing of every partition on its own thread.
+void pack_parts(size_t parts, const std::function<void(size_t)>& pack);
+}  // namespace detail
 }  // namespace fxlib
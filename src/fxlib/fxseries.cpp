@@ -0,0 +1,152 @@
+#include "fxseries.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FXLIB_SSE2
+#endif
+
+namespace fxlib {
+
+void fxseries::reserve(size_t n) {
+    time.reserve(n);
+    minute.reserve(n);
+    open.reserve(n);
+    close.reserve(n);
+    high.reserve(n);
+    low.reserve(n);
+    volume.reserve(n);
+    mean.reserve(n);
+}
+
+void fxseries::push_back(const fxcandle& c) {
+    time.push_back(c.time);
+    minute.push_back(ToEpochMinutes(c.time));
+    open.push_back(c.open);
+    close.push_back(c.close);
+    high.push_back(c.high);
+    low.push_back(c.low);
+    volume.push_back(c.volume);
+    mean.push_back(fxmean(c));
+}
+
+fxseries MakeSeries(const fxsequence& seq) {
+    fxseries ser = {seq.periodicity, seq.period, {}, {}, {}, {}, {}, {}, {}, {}};
+    ser.reserve(seq.candles.size());
+    for (const auto& c : seq.candles) {
+        ser.push_back(c);
+    }
+    return ser;
+}
+
+fxseries MakeSeries(const fxsequence_view& view) {
+    fxseries ser = {view.periodicity(), view.period(), {}, {}, {}, {}, {}, {}, {}, {}};
+    ser.reserve(view.size());
+    for (size_t i = 0; i < view.size(); i++) {
+        ser.push_back(view[i]);
+    }
+    return ser;
+}
+
+fxsequence MakeSequence(const fxseries& ser) {
+    fxsequence seq = {ser.periodicity, ser.period, {}};
+    seq.candles.reserve(ser.size());
+    for (size_t i = 0; i < ser.size(); i++) {
+        seq.candles.push_back(ser.candle(i));
+    }
+    return seq;
+}
+
+namespace {
+double column_max(const double* values, size_t count) {
+    double result = values[0];
+    size_t i = 1;
+#ifdef FXLIB_SSE2
+    __m128d acc = _mm_set1_pd(result);
+    for (; i + 2 <= count; i += 2) {
+        acc = _mm_max_pd(acc, _mm_loadu_pd(values + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    result = std::max(lanes[0], lanes[1]);
+#endif
+    for (; i < count; i++) {
+        result = std::max(result, values[i]);
+    }
+    return result;
+}
+
+double column_min(const double* values, size_t count) {
+    double result = values[0];
+    size_t i = 1;
+#ifdef FXLIB_SSE2
+    __m128d acc = _mm_set1_pd(result);
+    for (; i + 2 <= count; i += 2) {
+        acc = _mm_min_pd(acc, _mm_loadu_pd(values + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    result = std::min(lanes[0], lanes[1]);
+#endif
+    for (; i < count; i++) {
+        result = std::min(result, values[i]);
+    }
+    return result;
+}
+
+// Packing of the minute candles [first, last), the first candle opens a bucket. Buckets are found by the minute column,
+// ptime is converted only for the packed candles.
+void pack_range(const fxseries& minser, const fxbuckets& buckets, size_t first, size_t last, fxseries& resser) {
+    const auto& minute = minser.minute;
+    size_t i = first;
+    while (i < last) {
+        // The time of the packed candle is the end of its bucket.
+        const fxminutes end = buckets.end(buckets.index(minute[i]));
+        size_t j = i + 1;
+        while (j < last && minute[j] <= end) {
+            j++;
+        }
+        size_t volume = 0;
+        for (size_t k = i; k < j; k++) {
+            volume += minser.volume[k];
+        }
+        resser.push_back({FromEpochMinutes(end), minser.open[i], minser.close[j - 1],
+                          column_max(&minser.high[i], j - i), column_min(&minser.low[i], j - i), volume});
+        i = j;
+    }
+}
+
+template <typename T>
+void append_column(std::vector<T>& dst, const std::vector<T>& src) {
+    dst.insert(dst.end(), src.begin(), src.end());
+}
+}  // namespace
+
+fxseries PackSequence(const fxseries& minser, const boost::posix_time::time_duration& new_period, unsigned jobs) {
+    using namespace boost::posix_time;
+    if (minser.periodicity != minutes(1)) {
+        throw std::logic_error("Wrong source sequence periodicity");
+    }
+    const fxbuckets buckets = detail::pack_buckets(new_period);
+    const std::vector<size_t> bounds =
+        detail::pack_bounds(minser.size(), jobs, [&](size_t i) { return buckets.index(minser.minute[i]); });
+    const size_t parts = bounds.size() - 1;
+    std::vector<fxseries> packs(parts, fxseries{new_period, minser.period, {}, {}, {}, {}, {}, {}, {}, {}});
+    detail::pack_parts(parts, [&](size_t p) { pack_range(minser, buckets, bounds[p], bounds[p + 1], packs[p]); });
+    fxseries resser = std::move(packs[0]);
+    for (size_t p = 1; p < parts; p++) {
+        append_column(resser.time, packs[p].time);
+        append_column(resser.minute, packs[p].minute);
+        append_column(resser.open, packs[p].open);
+        append_column(resser.close, packs[p].close);
+        append_column(resser.high, packs[p].high);
+        append_column(resser.low, packs[p].low);
+        append_column(resser.volume, packs[p].volume);
+        append_column(resser.mean, packs[p].mean);
+    }
+    return resser;
+}
+
+}  // namespace fxlib
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "fxquote.h"
+
+#include <vector>
+
+namespace fxlib {
+
+/// Columnar (structure of arrays) storage of quote sequence.
+/**
+  Every field of candles is kept in its own contiguous array, so a pass that touches only one or two fields streams
+  only those bytes. The mean column is precomputed by fxmean() for each candle and the minute column keeps the time in
+  epoch minutes, so hot loops compare plain integers.
+*/
+struct fxseries {
+    // Periodicity of quotes in minutes, the same meaning as fxsequence::periodicity.
+    boost::posix_time::time_duration periodicity;
+    // Date of period, the same meaning as fxsequence::period.
+    boost::gregorian::date_period period;
+    std::vector<boost::posix_time::ptime> time;
+    std::vector<fxminutes> minute;
+    std::vector<double> open;
+    std::vector<double> close;
+    std::vector<double> high;
+    std::vector<double> low;
+    std::vector<size_t> volume;
+    std::vector<double> mean;
+
+    size_t size() const {
+        return time.size();
+    }
+    bool empty() const {
+        return time.empty();
+    }
+    fxcandle candle(size_t idx) const {
+        return {time[idx], open[idx], close[idx], high[idx], low[idx], volume[idx]};
+    }
+    void reserve(size_t n);
+    void push_back(const fxcandle& c);
+};
+
+static inline double fxprofit_mean_long(double close_mean, double open_mean) {
+    return close_mean - open_mean;
+}
+
+static inline double fxprofit_mean_short(double close_mean, double open_mean) {
+    return open_mean - close_mean;
+}
+
+using fprofit_mean_t = double (*)(double /*close mean*/, double /*open mean*/);
+
+fxseries MakeSeries(const fxsequence& seq);
+fxseries MakeSeries(const fxsequence_view& view);
+fxsequence MakeSequence(const fxseries& ser);
+
+/// Packing of minute quotes into candles of new_period, the result is the same as PackSequence of fxsequence.
+/**
+  Candles of a long series are split at bucket boundaries into partitions that are packed by jobs threads (0 means
+  the number of hardware threads), the candles are expected in order of time.
+*/
+fxseries PackSequence(const fxseries& minser, const boost::posix_time::time_duration& new_period,
+                      unsigned jobs = 0);
+
+}  // namespace fxlib
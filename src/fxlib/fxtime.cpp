@@ -1,7 +1,9 @@
 #include "fxtime.h"
 
+#include <algorithm>
 #include <map>
 #include <set>
+#include <stdexcept>
 
 namespace fxlib {
 
@@ -11,14 +13,28 @@ using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
 using boost::posix_time::time_period;
 
+namespace {
 // The Forex Market trading local hours ("wall clock").
-// static const time_duration fxSessionOpen {hours(8)};
-// static const time_duration fxSessionClose{hours(16)};
+const time_duration fxSessionOpen{hours(8)};
+const time_duration fxSessionClose{hours(16)};
 
-// struct fx_time_zone {
-//  time_duration winter;
-//  time_duration summer;
-//};
+const ptime fxEpoch(boost::gregorian::date(1970, 1, 1));
+
+// Day of a DST change as "week;weekday;month" of the Time Zone Database below, the week -1 is the last one.
+struct fx_dst_rule {
+    int week;
+    int weekday;  // 0 is Sunday
+    int month;
+    time_duration time;  // local time of the change
+};
+
+struct fx_time_zone {
+    fxsession session;
+    time_duration offset;  // GMT offset
+    time_duration dst;     // DST adjustment, zero without DST
+    fx_dst_rule start;     // by standard time
+    fx_dst_rule end;       // by daylight time
+};
 
 /** Fraction of Time Zone Database
 
@@ -32,30 +48,113 @@ Time","-05:00:00","+01:00:00","2;0;3","+02:00:00","1;0;11","+02:00:00"
 "Europe/Moscow","MSK","MSK","MSD","MSD","+03:00:00","+01:00:00","-1;0;3","+02:00:00","-1;0;10","+03:00:00"
 */
 
-// static const fx_time_zone fxMarketZones[] = {
-//  {hours(9), hours(10)},    // Sydney
-//  {hours(9), hours(9)},     // Tokyo
-//  {hours(0), hours(1)},     // London
-//  {hours(-5), hours(-4)},   // New York
-//};
-
-// bool IsForexWeekday(const boost::gregorian::date& date) noexcept {
-//  using namespace boost::gregorian;
-//  return date.day_of_week() >= Monday && date.day_of_week() <= Friday;
-//}
-
-// bool IsGMTDFST(const boost::gregorian::date& date) noexcept {
-//   using namespace boost::gregorian;
-//   day_iterator ditr_dst_start{{date.year(), Mar, 31}};
-//   while (ditr_dst_start->day_of_week() != Sunday) {
-//     ++ditr_dst_start;
-//   }
-//   day_iterator ditr_dst_end{{date.year(), Oct, 31}};
-//   while (ditr_dst_end->day_of_week() != Sunday) {
-//     --ditr_dst_end;
-//   }
-//   return date > *ditr_dst_start && date < *ditr_dst_end;
-// }
+const fx_time_zone fxMarketZones[] = {
+    {fxsydney, hours(10), hours(1), {1, 0, 10, hours(2)}, {1, 0, 4, hours(3)}},
+    {fxtokyo, hours(9), hours(0), {}, {}},
+    {fxlondon, hours(0), hours(1), {-1, 0, 3, hours(1)}, {-1, 0, 10, hours(2)}},
+    {fxnewyork, hours(-5), hours(1), {2, 0, 3, hours(2)}, {1, 0, 11, hours(2)}},
+};
+
+struct fx_dst_history {
+    fxsession session;
+    int last_year;      // the rules are in effect till the end of the year
+    fx_dst_rule start;  // by standard time
+    fx_dst_rule end;    // by daylight time
+};
+
+// Former DST rules of the zones since 2001 in order of years, London follows the current EU rules since 1996.
+// Sydney has ended DST on the last Sunday of March (on the first Sunday of April in 2006) and has started it on the
+// last Sunday of October till 2007, New York has changed DST on the first Sunday of April and the last Sunday of
+// October till 2006.
+const fx_dst_history fxDstHistory[] = {
+    {fxsydney, 2005, {-1, 0, 10, hours(2)}, {-1, 0, 3, hours(3)}},
+    {fxsydney, 2006, {-1, 0, 10, hours(2)}, {1, 0, 4, hours(3)}},
+    {fxsydney, 2007, {-1, 0, 10, hours(2)}, {-1, 0, 3, hours(3)}},
+    {fxnewyork, 2006, {1, 0, 4, hours(2)}, {-1, 0, 10, hours(2)}},
+};
+
+bool is_weekday(const boost::gregorian::date& date) noexcept {
+    using namespace boost::gregorian;
+    return date.day_of_week() >= Monday && date.day_of_week() <= Friday;
+}
+
+boost::gregorian::date change_date(const fx_dst_rule& rule, int year) {
+    using namespace boost::gregorian;
+    const greg_weekday weekday(static_cast<unsigned short>(rule.weekday));
+    const greg_month month(static_cast<unsigned short>(rule.month));
+    if (rule.week < 0) {
+        return last_day_of_the_week_in_month(weekday, month).get_date(year);
+    }
+    return first_day_of_the_week_in_month(weekday, month).get_date(year) + weeks(rule.week - 1);
+}
+
+// Whether DST is in effect at the local standard time of the zone.
+bool is_dst(const fx_time_zone& zone, const ptime& standard) {
+    if (zone.dst == hours(0)) {
+        return false;
+    }
+    const int year = standard.date().year();
+    const fx_dst_rule* start_rule = &zone.start;
+    const fx_dst_rule* end_rule = &zone.end;
+    for (const auto& history : fxDstHistory) {
+        if (history.session == zone.session && year <= history.last_year) {
+            start_rule = &history.start;
+            end_rule = &history.end;
+            break;
+        }
+    }
+    const ptime start(change_date(*start_rule, year), start_rule->time);
+    const ptime end(change_date(*end_rule, year), end_rule->time - zone.dst);
+    // DST of the southern hemisphere passes through the new year.
+    return start < end ? (standard >= start && standard < end) : (standard >= start || standard < end);
+}
+
+// Candle times (GMT) of the session of the local date, the session hours are far from DST changes at night.
+time_period session_hours(const fx_time_zone& zone, const boost::gregorian::date& local) {
+    const ptime open(local, fxSessionOpen);
+    const time_duration offset = is_dst(zone, open) ? zone.offset + zone.dst : zone.offset;
+    return time_period(open - offset + minutes(1), ptime(local, fxSessionClose) - offset + minutes(1));
+}
+}  // namespace
+
+fxminutes ToEpochMinutes(const ptime& time) noexcept(false) {
+    if (time.is_special()) {
+        throw std::logic_error("Invalid time to convert to epoch minutes.");
+    }
+    const int64_t secs = (time - fxEpoch).total_seconds();
+    return (secs >= 0 ? secs : secs - 59) / 60;
+}
+
+ptime FromEpochMinutes(fxminutes mins) noexcept {
+    return fxEpoch + minutes(static_cast<long>(mins));
+}
+
+fxbuckets::fxbuckets(const time_duration& period) noexcept(false)
+    : fxbuckets(period, ptime(boost::gregorian::date(1970, boost::gregorian::Jan, 4))) {}
+
+fxbuckets::fxbuckets(const time_duration& period, const ptime& anchor) noexcept(false)
+    : period_(ToMinutes(period)), anchor_(ToEpochMinutes(anchor)) {
+    if (period.total_seconds() % 60 != 0 || period_ <= 0) {
+        throw std::logic_error("Periodicity should be multiple minutes.");
+    }
+    if ((anchor - ptime(anchor.date())).total_seconds() % 60 != 0) {
+        throw std::logic_error("Anchor of buckets should be a whole minute.");
+    }
+}
+
+int64_t fxbuckets::index(const ptime& time) const noexcept(false) {
+    if (time.is_special()) {
+        throw std::logic_error("Invalid time to find its bucket.");
+    }
+    // A time with seconds belongs to the bucket of its next minute.
+    const int64_t secs = (time - fxEpoch).total_seconds();
+    const fxminutes mins = (secs >= 0 ? secs : secs - 59) / 60;
+    return ceil_div(mins - anchor_ + (secs > mins * 60 ? 1 : 0), period_);
+}
+
+ptime fxbuckets::end_time(int64_t index) const noexcept {
+    return FromEpochMinutes(end(index));
+}
 
 time_period ForexOpenHours(const boost::gregorian::date& d) noexcept {
     using namespace boost::gregorian;
@@ -76,4 +175,106 @@ time_period ForexOpenHours(const boost::gregorian::date& d) noexcept {
     return time_period(ptime(d), hours(0));
 }
 
+fxcalendar::fxcalendar(const boost::gregorian::date_period& period) : period_(period) {
+    prefix_.reserve(period.length().days() + 1);
+    prefix_.push_back(0);
+    for (boost::gregorian::day_iterator ditr = {period.begin()}; ditr < period.end(); ++ditr) {
+        hours_.push_back(ForexOpenHours(*ditr));
+        prefix_.push_back(prefix_.back() + hours_.back().length().total_seconds() / 60);
+    }
+}
+
+bool fxcalendar::is_open(const ptime& time) const noexcept(false) {
+    return hours_[day_index((time - minutes(1)).date())].contains(time);
+}
+
+time_duration fxcalendar::open_time(const ptime& from, const ptime& to) const noexcept(false) {
+    return minutes(static_cast<long>(open_minutes(to) - open_minutes(from)));
+}
+
+time_duration fxcalendar::open_time(const boost::gregorian::date_period& days) const noexcept(false) {
+    if (days.is_null()) {
+        return minutes(0);
+    }
+    const size_t first = day_index(days.begin());
+    const size_t last = day_index(days.last());
+    return minutes(static_cast<long>(prefix_[last + 1] - prefix_[first]));
+}
+
+size_t fxcalendar::day_index(const boost::gregorian::date& date) const noexcept(false) {
+    if (!period_.contains(date)) {
+        throw std::out_of_range("The date " + boost::gregorian::to_simple_string(date) +
+                                " is out of the trading calendar.");
+    }
+    return static_cast<size_t>((date - period_.begin()).days());
+}
+
+int64_t fxcalendar::open_minutes(const ptime& time) const noexcept(false) {
+    if (time == ptime(period_.begin())) {
+        return 0;
+    }
+    const size_t idx = day_index((time - minutes(1)).date());
+    const time_period& open = hours_[idx];
+    const int64_t part =
+        time < open.begin() ? 0 : std::min<int64_t>((time - open.begin()).total_seconds() / 60 + 1,
+                                                    open.length().total_seconds() / 60);
+    return prefix_[idx] + part;
+}
+
+fxsession_mask ForexSessions(const ptime& time) noexcept {
+    const ptime minute = time - minutes(1);
+    fxsession_mask mask = 0;
+    for (const auto& zone : fxMarketZones) {
+        // The local date by standard or daylight time.
+        for (const auto& local : {(minute + zone.offset).date(), (minute + zone.offset + zone.dst).date()}) {
+            if (is_weekday(local) && session_hours(zone, local).contains(time)) {
+                mask |= zone.session;
+            }
+        }
+    }
+    return mask;
+}
+
+fxsession_map::fxsession_map(const boost::gregorian::date_period& period)
+    : period_(period),
+      begin_(ToEpochMinutes(ptime(period.begin()))),
+      masks_(static_cast<size_t>(period.length().days()) * 24 * 60) {
+    const time_period range(ptime(period.begin(), minutes(1)), ptime(period.end(), minutes(1)));
+    for (const auto& zone : fxMarketZones) {
+        // Sessions of the local days around the period can overlap it.
+        for (boost::gregorian::day_iterator ditr = {period.begin() - boost::gregorian::days(1)};
+             ditr <= period.end(); ++ditr) {
+            if (!is_weekday(*ditr)) {
+                continue;
+            }
+            const time_period hours = session_hours(zone, *ditr).intersection(range);
+            if (hours.is_null()) {
+                continue;
+            }
+            const size_t first = static_cast<size_t>((hours.begin() - range.begin()).total_seconds() / 60);
+            const size_t last = static_cast<size_t>((hours.end() - range.begin()).total_seconds() / 60);
+            for (size_t i = first; i < last; i++) {
+                masks_[i] |= zone.session;
+            }
+        }
+    }
+}
+
+fxsession_mask fxsession_map::mask(fxminutes time) const noexcept(false) {
+    const int64_t idx = time - begin_ - 1;
+    if (idx < 0 || static_cast<size_t>(idx) >= masks_.size()) {
+        throw std::out_of_range("The time " + boost::posix_time::to_simple_string(FromEpochMinutes(time)) +
+                                " is out of the session map.");
+    }
+    return masks_[static_cast<size_t>(idx)];
+}
+
+fxsession_filter::fxsession_filter(const boost::gregorian::date_period& period,
+                                   const boost::optional<fxsession_mask>& sessions)
+    : sessions_(sessions.value_or(fxall_sessions)) {
+    if (sessions.is_initialized()) {
+        map_.emplace(period);
+    }
+}
+
 }  // namespace fxlib
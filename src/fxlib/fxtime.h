@@ -2,10 +2,148 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <vector>
 
 namespace fxlib {
 
+// Compact time of hot loops: minutes since 1970-01-01 00:00 (GMT), ptime is converted only at the edges.
+using fxminutes = int64_t;
+
+// Seconds are truncated, the time should not be special.
+fxminutes ToEpochMinutes(const boost::posix_time::ptime& time) noexcept(false);
+boost::posix_time::ptime FromEpochMinutes(fxminutes mins) noexcept;
+// Duration in whole minutes.
+static inline fxminutes ToMinutes(const boost::posix_time::time_duration& duration) noexcept {
+    return duration.total_seconds() / 60;
+}
+
+/// Buckets of candle times to resample quotes into a longer period.
+/**
+  A bucket is named by its end time anchor + index * period and holds candle times in (end - period, end], like a candle
+  holds the minutes before its time. The index is a plain integer division, so a gap of any length costs the same.
+  The anchor is an end of any bucket, Sunday 00:00 GMT by default: periods dividing a day are aligned to midnight and
+  the whole trading week of ForexOpenHours falls into one weekly bucket.
+*/
+class fxbuckets {
+ public:
+    explicit fxbuckets(const boost::posix_time::time_duration& period) noexcept(false);
+    // The period should be a multiple of minutes.
+    fxbuckets(const boost::posix_time::time_duration& period, const boost::posix_time::ptime& anchor) noexcept(false);
+
+    boost::posix_time::time_duration period() const {
+        return boost::posix_time::minutes(static_cast<long>(period_));
+    }
+    // Index of the bucket of the candle time.
+    int64_t index(fxminutes time) const noexcept {
+        return ceil_div(time - anchor_, period_);
+    }
+    int64_t index(const boost::posix_time::ptime& time) const noexcept(false);
+    // End time of the bucket.
+    fxminutes end(int64_t index) const noexcept {
+        return anchor_ + index * period_;
+    }
+    boost::posix_time::ptime end_time(int64_t index) const noexcept;
+
+ private:
+    static int64_t ceil_div(int64_t a, int64_t b) noexcept {
+        return a / b + (a % b > 0 ? 1 : 0);
+    }
+
+    fxminutes period_;
+    fxminutes anchor_;
+};
+
 // Returns time period for certain date when the market is opened (GMT).
 boost::posix_time::time_period ForexOpenHours(const boost::gregorian::date& date) noexcept;
 
+/// Trading calendar of the days of a period by ForexOpenHours.
+/**
+  Open minutes are counted by candle times: a candle time ends its minute, so the 00:00 candle belongs to the previous
+  day. Prefix sums of open minutes per day make any query a constant time one. Only times in [begin 00:00, end 00:00]
+  of the period are supported.
+*/
+class fxcalendar {
+ public:
+    explicit fxcalendar(const boost::gregorian::date_period& period);
+
+    const boost::gregorian::date_period& period() const {
+        return period_;
+    }
+    // Whether the candle time is in open hours of its day.
+    bool is_open(const boost::posix_time::ptime& time) const noexcept(false);
+    // Open time of candle times in (from, to].
+    boost::posix_time::time_duration open_time(const boost::posix_time::ptime& from,
+                                               const boost::posix_time::ptime& to) const noexcept(false);
+    // Open time of the days, they should be in the period.
+    boost::posix_time::time_duration open_time(const boost::gregorian::date_period& days) const noexcept(false);
+
+ private:
+    size_t day_index(const boost::gregorian::date& date) const noexcept(false);
+    // Number of open candle times from the period begin up to the time inclusively.
+    int64_t open_minutes(const boost::posix_time::ptime& time) const noexcept(false);
+
+    boost::gregorian::date_period period_;
+    std::vector<boost::posix_time::time_period> hours_;
+    std::vector<int64_t> prefix_;  // open minutes before the day
+};
+
+// Trading sessions of the Forex Market by their financial centers, a mask of sessions is a bitwise OR of them.
+enum fxsession : uint8_t { fxsydney = 0x01, fxtokyo = 0x02, fxlondon = 0x04, fxnewyork = 0x08 };
+using fxsession_mask = uint8_t;
+constexpr fxsession_mask fxall_sessions = fxsydney | fxtokyo | fxlondon | fxnewyork;
+
+// Sessions open at the candle time (GMT): from 08:00 till 16:00 of local weekdays with DST of the center.
+// DST rules of the centers are known since 2001, earlier years are taken by the rules of 2001.
+fxsession_mask ForexSessions(const boost::posix_time::ptime& time) noexcept;
+
+/// Masks of open sessions by ForexSessions for every candle time of a period.
+/**
+  One byte per minute is precomputed from session hours of every local day, so a test of a candle is an index and
+  a bitwise AND. Candle times in (begin 00:00, end 00:00] of the period are supported.
+*/
+class fxsession_map {
+ public:
+    explicit fxsession_map(const boost::gregorian::date_period& period);
+
+    const boost::gregorian::date_period& period() const {
+        return period_;
+    }
+    fxsession_mask mask(const boost::posix_time::ptime& time) const noexcept(false) {
+        return mask(ToEpochMinutes(time));
+    }
+    fxsession_mask mask(fxminutes time) const noexcept(false);
+    // Whether any of the sessions is open at the candle time.
+    bool is_open(const boost::posix_time::ptime& time, fxsession_mask sessions) const noexcept(false) {
+        return (mask(time) & sessions) != 0;
+    }
+    bool is_open(fxminutes time, fxsession_mask sessions) const noexcept(false) {
+        return (mask(time) & sessions) != 0;
+    }
+
+ private:
+    boost::gregorian::date_period period_;
+    fxminutes begin_;  // the period begin 00:00
+    std::vector<fxsession_mask> masks_;  // of candle times begin 00:01, 00:02 ...
+};
+
+/// Filter of candles by the sessions a user has chosen, every candle is accepted when no sessions are given.
+class fxsession_filter {
+ public:
+    fxsession_filter(const boost::gregorian::date_period& period, const boost::optional<fxsession_mask>& sessions);
+
+    bool accepts(const boost::posix_time::ptime& time) const noexcept(false) {
+        return !map_ || map_->is_open(time, sessions_);
+    }
+    bool accepts(fxminutes time) const noexcept(false) {
+        return !map_ || map_->is_open(time, sessions_);
+    }
+
+ private:
+    boost::optional<fxsession_map> map_;  // only when sessions are given
+    fxsession_mask sessions_;
+};
+
 }  // namespace fxlib
@@ -28,6 +28,51 @@ struct fxsequence_header_bin {
     } period;
 };
 
+// Version 2 of the binary format starts with the magic instead of the periodicity. Candles are delta encoded in blocks
+// (see fxblock_header_bin), the block index follows the last block. Appending moves the index past new blocks at the
+// end of the file, so blocks are found by the index only.
+static const char fxsequence_magic_v2[4] = {'F', 'X', 'Q', '2'};
+
+struct fxsequence_header_v2_bin {
+    char magic[4];
+    fxperiodicity_bin periodicity;
+    uint32_t count;
+    struct {
+        fxtime start;
+        fxtime end;
+    } period;
+    uint32_t block_count;
+    uint64_t index_offset;  // from the beginning of the file
+};
+
+struct fxblock_header_bin {
+    uint32_t count;
+    uint32_t size;        // of encoded candles that follow the header
+    uint32_t price_unit;  // in millionth, all prices of the block are multiple of it
+};
+
+struct fxblock_index_bin {
+    fxtime first;
+    fxtime last;
+    uint32_t count;
+    uint64_t offset;  // of the block header from the beginning of the file
+};
+
+// A pyramid of packed sequences (see fxpyramid) may follow the sequence of a file: the header, the table of levels and
+// the levels one after another. Levels are written in the compressed format without cutting volumes to 16 bits.
+static const char fxpyramid_magic[4] = {'F', 'X', 'P', '1'};
+
+struct fxpyramid_header_bin {
+    char magic[4];
+    uint32_t level_count;
+};
+
+struct fxpyramid_level_bin {
+    fxperiodicity_bin periodicity;
+    uint64_t offset;  // of the level sequence from the beginning of the file
+    uint64_t size;
+};
+
 #pragma pack(pop)
 }  // namespace detail
 
@@ -51,4 +96,54 @@ static inline std::istream& operator>>(std::istream& in, detail::fxcandle_bin& c
     return in;
 }
 
+static inline std::ostream& operator<<(std::ostream& out, const detail::fxsequence_header_v2_bin& header) noexcept {
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return out;
+}
+
+static inline std::istream& operator>>(std::istream& in, detail::fxsequence_header_v2_bin& header) noexcept {
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    return in;
+}
+
+static inline std::ostream& operator<<(std::ostream& out, const detail::fxblock_header_bin& block) noexcept {
+    out.write(reinterpret_cast<const char*>(&block), sizeof(block));
+    return out;
+}
+
+static inline std::istream& operator>>(std::istream& in, detail::fxblock_header_bin& block) noexcept {
+    in.read(reinterpret_cast<char*>(&block), sizeof(block));
+    return in;
+}
+
+static inline std::ostream& operator<<(std::ostream& out, const detail::fxblock_index_bin& index) noexcept {
+    out.write(reinterpret_cast<const char*>(&index), sizeof(index));
+    return out;
+}
+
+static inline std::istream& operator>>(std::istream& in, detail::fxblock_index_bin& index) noexcept {
+    in.read(reinterpret_cast<char*>(&index), sizeof(index));
+    return in;
+}
+
+static inline std::ostream& operator<<(std::ostream& out, const detail::fxpyramid_header_bin& header) noexcept {
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return out;
+}
+
+static inline std::istream& operator>>(std::istream& in, detail::fxpyramid_header_bin& header) noexcept {
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    return in;
+}
+
+static inline std::ostream& operator<<(std::ostream& out, const detail::fxpyramid_level_bin& level) noexcept {
+    out.write(reinterpret_cast<const char*>(&level), sizeof(level));
+    return out;
+}
+
+static inline std::istream& operator>>(std::istream& in, detail::fxpyramid_level_bin& level) noexcept {
+    in.read(reinterpret_cast<char*>(&level), sizeof(level));
+    return in;
+}
+
 }  // namespace fxlib
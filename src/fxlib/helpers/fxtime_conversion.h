@@ -2,8 +2,11 @@
 
 #include "fxtime_serializable.h"
 
+#include <boost/date_time/gregorian/gregorian_types.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <cstdint>
 #include <iostream>
 
 namespace fxlib {
@@ -57,6 +60,76 @@ static inline std::istream& operator>>(std::istream& in, fxtime& time) noexcept
     return in;
 }
 
+namespace detail {
+
+static inline bool bcd_to_int(uint8_t b, int& val) noexcept {
+    const int dh = b >> 4;
+    const int dl = b & 0xF;
+    if (dh > 9 || dl > 9) {
+        return false;
+    }
+    val = dh * 10 + dl;
+    return true;
+}
+
+static inline uint8_t int_to_bcd(int val) noexcept {
+    return static_cast<uint8_t>(((val / 10) << 4) | (val % 10));
+}
+
+// Days since 1970-01-01 of the proleptic Gregorian date (H. Hinnant's days_from_civil).
+static inline int64_t days_from_civil(int y, int m, int d) noexcept {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const int64_t yoe = y - era * 400;
+    const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static inline void civil_from_days(int64_t z, int& y, int& m, int& d) noexcept {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t doe = z - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    d = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    m = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    y = static_cast<int>(yoe + era * 400 + (m <= 2));
+}
+
+struct fxtime_fields {
+    int year;
+    int month;
+    int day;
+    int hours;
+    int minutes;
+    int seconds;
+};
+
+// Unpacks BCD digits and checks that they form a valid date and time of day.
+static inline bool unpack_fxtime(const fxtime& t, fxtime_fields& f) noexcept {
+    const auto& b = t.data;
+    int yh, yl;
+    if (b[4] != 0xDD || !bcd_to_int(b[0], yh) || !bcd_to_int(b[1], yl) || !bcd_to_int(b[2], f.month) ||
+        !bcd_to_int(b[3], f.day) || !bcd_to_int(b[5], f.hours) || !bcd_to_int(b[6], f.minutes) ||
+        !bcd_to_int(b[7], f.seconds)) {
+        return false;
+    }
+    f.year = yh * 100 + yl;
+    return f.year >= 1400 && f.month >= 1 && f.month <= 12 && f.day >= 1 &&
+           f.day <= boost::gregorian::gregorian_calendar::end_of_month_day(static_cast<unsigned short>(f.year),
+                                                                           static_cast<unsigned short>(f.month)) &&
+           f.hours < 24 && f.minutes < 60 && f.seconds < 60;
+}
+
+static inline fxtime pack_fxtime(const fxtime_fields& f) noexcept {
+    return {{int_to_bcd(f.year / 100), int_to_bcd(f.year % 100), int_to_bcd(f.month), int_to_bcd(f.day), 0xDD,
+             int_to_bcd(f.hours), int_to_bcd(f.minutes), int_to_bcd(f.seconds)}};
+}
+
+}  // namespace detail
+
 namespace conversion {
 
 static inline std::string to_iso_string(const fxtime& t) noexcept(false) {
@@ -83,5 +156,91 @@ static inline bool try_from_iso_string(const std::string& str, fxtime& t) noexce
     return boost::conversion::try_lexical_convert(str, t);
 }
 
+// Direct BCD <-> ptime/epoch-minute codec, it does neither strings nor allocations.
+
+static inline bool try_to_ptime(const fxtime& t, boost::posix_time::ptime& time) noexcept {
+    detail::fxtime_fields f;
+    if (!detail::unpack_fxtime(t, f)) {
+        return false;
+    }
+    using namespace boost::gregorian;
+    using namespace boost::posix_time;
+    time = ptime(date(static_cast<unsigned short>(f.year), static_cast<unsigned short>(f.month),
+                      static_cast<unsigned short>(f.day)),
+                 time_duration(f.hours, f.minutes, f.seconds));
+    return true;
+}
+
+static inline boost::posix_time::ptime to_ptime(const fxtime& t) noexcept(false) {
+    boost::posix_time::ptime time;
+    if (!try_to_ptime(t, time)) {
+        throw std::bad_cast::__construct_from_string_literal("Invalid fxtime");
+    }
+    return time;
+}
+
+static inline bool try_from_ptime(const boost::posix_time::ptime& time, fxtime& t) noexcept {
+    if (time.is_special()) {
+        return false;
+    }
+    const auto ymd = time.date().year_month_day();
+    const auto tod = time.time_of_day();
+    if (ymd.year > 9999 || tod.hours() > 23) {
+        return false;
+    }
+    t = detail::pack_fxtime({ymd.year, ymd.month, ymd.day, static_cast<int>(tod.hours()),
+                             static_cast<int>(tod.minutes()), static_cast<int>(tod.seconds())});
+    return true;
+}
+
+static inline fxtime from_ptime(const boost::posix_time::ptime& time) noexcept(false) {
+    fxtime t;
+    if (!try_from_ptime(time, t)) {
+        throw std::bad_cast::__construct_from_string_literal("Invalid ptime");
+    }
+    return t;
+}
+
+// Minutes since 1970-01-01 00:00, seconds are truncated.
+static inline bool try_to_epoch_minutes(const fxtime& t, int64_t& mins) noexcept {
+    detail::fxtime_fields f;
+    if (!detail::unpack_fxtime(t, f)) {
+        return false;
+    }
+    mins = detail::days_from_civil(f.year, f.month, f.day) * 1440 + f.hours * 60 + f.minutes;
+    return true;
+}
+
+static inline int64_t to_epoch_minutes(const fxtime& t) noexcept(false) {
+    int64_t mins;
+    if (!try_to_epoch_minutes(t, mins)) {
+        throw std::bad_cast::__construct_from_string_literal("Invalid fxtime");
+    }
+    return mins;
+}
+
+static inline bool try_from_epoch_minutes(int64_t mins, fxtime& t) noexcept {
+    const int64_t days = (mins >= 0 ? mins : mins - 1439) / 1440;
+    const int64_t tod = mins - days * 1440;
+    detail::fxtime_fields f;
+    detail::civil_from_days(days, f.year, f.month, f.day);
+    if (f.year < 1400 || f.year > 9999) {
+        return false;
+    }
+    f.hours = static_cast<int>(tod / 60);
+    f.minutes = static_cast<int>(tod % 60);
+    f.seconds = 0;
+    t = detail::pack_fxtime(f);
+    return true;
+}
+
+static inline fxtime from_epoch_minutes(int64_t mins) noexcept(false) {
+    fxtime t;
+    if (!try_from_epoch_minutes(mins, t)) {
+        throw std::bad_cast::__construct_from_string_literal("Invalid epoch minutes");
+    }
+    return t;
+}
+
 }  // namespace conversion
 }  // namespace fxlib
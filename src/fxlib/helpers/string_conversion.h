@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../fxtime.h"
+
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/regex.hpp>
@@ -7,6 +9,7 @@
 #include <string>
 #include <algorithm>
 #include <iterator>
+#include <vector>
 
 namespace fxlib {
 namespace conversion {
@@ -62,5 +65,48 @@ static inline boost::posix_time::time_duration duration_from_string(const std::s
     return time_duration{};
 }
 
+static inline std::string session_to_string(fxsession session) {
+    switch (session) {
+        case fxsydney:
+            return "sydney";
+        case fxtokyo:
+            return "tokyo";
+        case fxlondon:
+            return "london";
+        case fxnewyork:
+            return "newyork";
+        default:
+            break;
+    }
+    return std::string{};
+}
+
+// Comma separated names of sessions (sydney, tokyo, london, newyork) or "all".
+static inline fxsession_mask sessions_from_string(const std::string& str) {
+    using namespace std;
+    const string lower = boost::algorithm::to_lower_copy(str);
+    vector<string> names;
+    boost::algorithm::split(names, lower, boost::algorithm::is_any_of(","));
+    fxsession_mask mask = 0;
+    for (const auto& name : names) {
+        const string s = boost::algorithm::trim_copy(name);
+        if (s == "all") {
+            mask |= fxall_sessions;
+            continue;
+        }
+        fxsession_mask found = 0;
+        for (const fxsession session : {fxsydney, fxtokyo, fxlondon, fxnewyork}) {
+            if (s == session_to_string(session)) {
+                found = session;
+            }
+        }
+        if (found == 0) {
+            throw std::invalid_argument("Wrong session '" + s + "'");
+        }
+        mask |= found;
+    }
+    return mask;
+}
+
 }  // namespace conversion
 }  // namespace fxlib
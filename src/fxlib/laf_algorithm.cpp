@@ -13,7 +13,11 @@ LafTrainer::LafTrainer(const boost::property_tree::ptree& settings, std::ostream
 LafTrainer::~LafTrainer() = default;
 
 void LafTrainer::PrepareTrainingSet(const fxsequence& seq, std::ostream& out) const {
-    impl_->prepare_training_set(seq, out);
+    impl_->prepare_training_set(seq, fxpyramid(), out);
+}
+
+void LafTrainer::PrepareTrainingSet(const fxsequence& seq, const fxpyramid& pyramid, std::ostream& out) const {
+    impl_->prepare_training_set(seq, pyramid, out);
 }
 
 boost::property_tree::ptree LafTrainer::LoadAndTrain(std::istream& in) {
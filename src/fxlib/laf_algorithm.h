@@ -16,6 +16,7 @@ class LafTrainer : public ITrainer {
     ~LafTrainer();
 
     void PrepareTrainingSet(const fxsequence& seq, std::ostream& out) const override;
+    void PrepareTrainingSet(const fxsequence& seq, const fxpyramid& pyramid, std::ostream& out) const override;
     boost::property_tree::ptree LoadAndTrain(std::istream&) override;
 
  private:
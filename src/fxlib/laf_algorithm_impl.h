@@ -4,8 +4,6 @@
 #include "laf_algorithm_def.h"
 #include "helpers/nnetwork_helpers.h"
 
-#include <boost/optional.hpp>
-
 namespace fxlib {
 
 namespace details {
@@ -84,16 +82,16 @@ class LafAlgorithm::Impl {
  public:
     Impl(const boost::property_tree::ptree& settings);
 
+    // Candles are aggregated by fxresampler, so they should follow in strict time order (std::logic_error otherwise).
     double feed(const fxcandle& candle);
     void reset();
     ForecastInfo info() const;
 
  private:
     const details::laf_cfg cfg_;
+    fxresampler resampler_;  // aggregates candles of an input
     std::shared_ptr<details::ilaf_impl> laf_impl_;
     std::vector<double> inputs_;
-    boost::optional<boost::posix_time::time_iterator> time_bound_;
-    fxcandle aggr_candle_ = fxcandle();
 };
 
 }  // namespace fxlib
@@ -27,7 +27,7 @@ LafTrainer::Impl::Impl(const boost::property_tree::ptree& settings, std::ostream
     laf_impl_ = details::make_laf_impl(cfg_.type);
 }
 
-void LafTrainer::Impl::prepare_training_set(const fxsequence& seq, std::ostream& out) const {
+void LafTrainer::Impl::prepare_training_set(const fxsequence& seq, const fxpyramid& pyramid, std::ostream& out) const {
     using namespace std;
     headline_ << "Estimating genuine positions..." << endl;
     double time_adjust;
@@ -37,22 +37,23 @@ void LafTrainer::Impl::prepare_training_set(const fxsequence& seq, std::ostream&
         fxlib::GenuinePositions(seq, cfg_.timeout, cfg_.position == fxposition::fxlong ? fxprofit_long : fxprofit_short,
                                 cfg_.margin * cfg_.pip, time_adjust, probab, durat);
     headline_ << "Genuine positions: " << marks.size() << endl;
-    headline_ << "Pack quotes to " << cfg_.step << "..." << endl;
-    const auto pack_seq = PackSequence(seq, cfg_.step);
-    headline_ << "New size of the sequence: " << pack_seq.candles.size() << endl;
+    const fxsequence* level = pyramid.find(cfg_.step);
+    headline_ << (level != nullptr ? "Take quotes packed to " : "Pack quotes to ") << cfg_.step << "..." << endl;
+    const auto pack_ser = level != nullptr ? MakeSeries(*level) : MakeSeries(PackSequence(seq, cfg_.step));
+    headline_ << "New size of the sequence: " << pack_ser.size() << endl;
     const size_t ninputs = laf_impl_->inputs_number();
-    if (pack_seq.candles.size() > ninputs) {
+    if (pack_ser.size() > ninputs) {
         double mean = 0;
-        for (const auto& c : pack_seq.candles) {
-            mean += fxmean(c);
+        for (const double m : pack_ser.mean) {
+            mean += m;
         }
-        mean /= pack_seq.candles.size();
+        mean /= pack_ser.size();
         double var = 0;
-        for (const auto& c : pack_seq.candles) {
-            const double dv = fxmean(c) - mean;
+        for (const double m : pack_ser.mean) {
+            const double dv = m - mean;
             var += dv * dv;
         }
-        var = sqrt(var / (pack_seq.candles.size() - 1));
+        var = sqrt(var / (pack_ser.size() - 1));
         headline_ << "mean: " << mean << ", variance: " << var << endl;
         out.write(reinterpret_cast<const char*>(&mean), sizeof(mean));
         out.write(reinterpret_cast<const char*>(&var), sizeof(var));
@@ -60,15 +61,15 @@ void LafTrainer::Impl::prepare_training_set(const fxsequence& seq, std::ostream&
         vector<double> positives;
         vector<double> negatives;
         size_t count = 0;
-        for (auto iter = pack_seq.candles.cbegin() + (ninputs - 1); iter < pack_seq.candles.cend(); ++iter, ++count) {
+        for (size_t idx = ninputs - 1; idx < pack_ser.size(); ++idx, ++count) {
             log_ << setw(6) << count;
             vector<double> sample;
-            for (auto aux_iter = iter - (ninputs - 1); aux_iter <= iter; ++aux_iter) {
-                const double val = (fxmean(*aux_iter) - mean) / var;
+            for (size_t aux_idx = idx - (ninputs - 1); aux_idx <= idx; ++aux_idx) {
+                const double val = (pack_ser.mean[aux_idx] - mean) / var;
                 log_ << setw(10) << val;
                 sample.push_back(val);
             }
-            auto gen_range = check_pos(iter->time, marks, cfg_.window);
+            auto gen_range = check_pos(pack_ser.time[idx], marks, cfg_.window);
             const size_t win_size = cfg_.window.total_seconds() / 60;
             const size_t gen_size = gen_range.second - gen_range.first;
             if (gen_size > win_size) {
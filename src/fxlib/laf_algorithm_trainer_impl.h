@@ -23,7 +23,7 @@ class LafTrainer::Impl {
  public:
     Impl(const boost::property_tree::ptree& settings, std::ostream& headline, std::ostream& log);
 
-    void prepare_training_set(const fxsequence& seq, std::ostream& out) const;
+    void prepare_training_set(const fxsequence& seq, const fxpyramid& pyramid, std::ostream& out) const;
     boost::property_tree::ptree load_and_train(std::istream&);
 
  private:
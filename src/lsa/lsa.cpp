@@ -26,8 +26,10 @@ using boost::posix_time::time_duration;
 
 using fxlib::fxdurat_coefs;
 using fxlib::fxmargin_distribution;
+using fxlib::fxmargin_histogram;
 using fxlib::fxmargin_probability;
-using fxlib::fxmargin_samples;
+using fxlib::fxmargin_sample;
+using fxlib::fxrunning_stats;
 using fxlib::fxprobab_coefs;
 
 namespace {
@@ -36,6 +38,20 @@ boost::filesystem::path g_outpath;
 double g_pip = 0.0001;
 double g_alpha = 0.1;
 size_t g_distr_size;
+// Sessions to filter candles, no filtering by default.
+boost::optional<fxlib::fxsession_mask> g_sessions;
+// Days of quotes to be loaded, the whole sequence by default.
+boost::gregorian::date_period g_period(boost::gregorian::date(boost::date_time::min_date_time),
+                                       boost::gregorian::date(boost::date_time::max_date_time));
+
+void SetFromDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(boost::gregorian::from_simple_string(str), g_period.end());
+}
+
+void SetToDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(g_period.begin(),
+                                             boost::gregorian::from_simple_string(str) + boost::gregorian::days(1));
+}
 }  // namespace
 
 bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
@@ -48,18 +64,25 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
         "source,s", value<string>()->required()->value_name("pair-bin")->notifier([](const string& srcname) {
             g_srcbin = boost::filesystem::canonical(srcname);
         }),
-        "Path to compiled (binary) quotes.")("quick,q", bool_switch(&quick_mode), "Start a quick (simple) analyze.");
+        "Path to compiled (binary) quotes.")("quick,q", bool_switch(&quick_mode), "Start a quick (simple) analyze.")(
+        "from", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetFromDate), "First day of quotes to load.")(
+        "to", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetToDate), "Last day of quotes to load.");
     options_description quick_desc("Quick analyze options", 200);
-    quick_desc.add_options()("position,p", value<string>()->required()->value_name("{long|short}"),
-                             "What position to be analyzed.")(
-        "timeout,t", value<string>()->required()->value_name("n{m,h,d,w}"),
-        "How far to look into future (minutes, hours, days, weeks).")(
+    quick_desc.add_options()("position,p", value<string>()->required()->value_name("{long|short}[,...]"),
+                             "What positions to be analyzed.")(
+        "timeout,t", value<string>()->required()->value_name("n{m,h,d,w}[,...]"),
+        "How far to look into future (minutes, hours, days, weeks), all the timeouts are analyzed by a single pass.")(
         "out,o", value<string>()->value_name("[path]")->implicit_value("")->notifier([](const string& outname) {
             g_outpath = boost::filesystem::canonical(outname);
         }),
         "Optionally distributions and probabilities can be written into output files.")(
         "distsize,d", value<size_t>(&g_distr_size)->default_value(150)->value_name("size"),
-        "Number of intervals to build a distribution.");
+        "Number of intervals to build a distribution.")(
+        "sessions", value<string>()->value_name("names")->notifier([](const string& names) {
+            g_sessions = fxlib::conversion::sessions_from_string(names);
+        }),
+        "Open positions only in the sessions (sydney,tokyo,london,newyork), at any time by default "
+        "(DST rules since 2001).");
     options_description additional_desc("Additional options", 200);
     additional_desc.add_options()("pip,z", value<double>(&g_pip)->value_name("size"),
                                   "Pip size, usually 0.0001 or 0.01.")(
@@ -87,10 +110,8 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
     return true;
 }
 
-fxmargin_distribution BuildDistribution(const fxmargin_samples& samples, const double from, const double step,
-                                        const std::string& name) {
+void CheckDistribution(const fxmargin_distribution& distrib, size_t N, const std::string& name) {
     using namespace std;
-    fxmargin_distribution distrib = fxlib::MarginDistribution(samples, g_distr_size, from, step);
     if (distrib.size() != g_distr_size + 3) {
         throw logic_error("Invalid size of " + name + " distribution!");
     }
@@ -104,20 +125,17 @@ fxmargin_distribution BuildDistribution(const fxmargin_samples& samples, const d
              << setprecision(3) << (distrib.back().bound / g_pip) << " value" << endl;
     }
     if (accumulate(distrib.cbegin(), distrib.cend(), size_t(0), [](size_t a, const auto& b) { return a + b.count; }) !=
-        samples.size()) {
+        N) {
         throw logic_error("Sum of " + name + " distribution is not equal the total number!");
     }
-    return distrib;
 }
 
-fxmargin_probability BuildProbability(const fxmargin_samples& samples, const double from, const double step,
-                                      const std::string& name) {
+void CheckProbability(const fxmargin_probability& probab, size_t N, const std::string& name) {
     using namespace std;
-    auto probab = fxlib::MarginProbability(samples, g_distr_size, from, step);
     if (probab.size() != g_distr_size + 3) {
         throw logic_error("Invalid size of " + name + " probability!");
     }
-    if (probab.front().count != samples.size()) {
+    if (probab.front().count != N) {
         cout << "[ERROR] There are extra data in " + name + " before " << fixed << setprecision(3)
              << (probab.front().bound / g_pip) << endl;
         throw logic_error("Something has gone wrong!");
@@ -126,7 +144,6 @@ fxmargin_probability BuildProbability(const fxmargin_samples& samples, const dou
         cout << "[NOTE] There are " << probab.back().count << " extra data in " + name + " beyond " << fixed
              << setprecision(3) << (probab.back().bound / g_pip) << " value" << endl;
     }
-    return probab;
 }
 
 // tuple<double,double,double> => mean, confidence width, variance.
@@ -155,75 +172,205 @@ std::vector<std::string> PrepareOutputStrings(const size_t N, const std::tuple<d
     return strs;
 }
 
-void QuickAnalyze(const variables_map& vm, const fxlib::fxsequence seq) {
-    using namespace std;
-    const time_duration timeout = fxlib::conversion::duration_from_string(vm["timeout"].as<string>());
-    const string positon = boost::algorithm::to_lower_copy(vm["position"].as<string>());
-    fxlib::fprofit_t profit;
+// Samples of a position with a timeout, the samples of all of them are collected by a single pass over the series.
+/*
+  Samples are not kept, the first pass gives their stats and the second one fills the histograms that are bounded
+  by the stats, so the samples take the same memory for any length of the sequence.
+*/
+struct quick_samples {
+    std::string position;
+    std::string timeout;  // as it is given by the command line
+    fxlib::fprofit_mean_t profit;
+    fxrunning_stats limits;
+    fxrunning_stats losses;
+    boost::optional<fxmargin_histogram> limit_hist;
+    boost::optional<fxmargin_histogram> loss_hist;
+    // Samples grouped by sessions of the open time when sessions are chosen: number, sums of limits and losses.
+    size_t session_N[4];
+    double session_limits[4];
+    double session_losses[4];
+    // Times of the first and the last counted candidates.
+    boost::posix_time::ptime first_open;
+    boost::posix_time::ptime last_open;
+};
+
+const fxlib::fxsession session_list[] = {fxlib::fxsydney, fxlib::fxtokyo, fxlib::fxlondon, fxlib::fxnewyork};
+
+fxlib::fprofit_mean_t ProfitOf(const std::string& positon) {
     if (positon == "long") {
-        profit = fxlib::fxprofit_long;
+        return fxlib::fxprofit_mean_long;
     } else if (positon == "short") {
-        profit = fxlib::fxprofit_short;
-    } else {
-        throw invalid_argument("Wrong position '" + positon + "'");
+        return fxlib::fxprofit_mean_short;
     }
-    cout << "Analyzing near " << seq.candles.size() << " " << positon << " positions with " << timeout << " timeout..."
-         << endl;
-    fxmargin_samples limits;
-    fxmargin_samples losses;
-    limits.reserve(seq.candles.size());
-    losses.reserve(seq.candles.size());
-    boost::optional<boost::posix_time::ptime> prev_time;
-    double min_adjust = 0;
-    size_t curr_idx = 0;
+    throw std::invalid_argument("Wrong position '" + positon + "'");
+}
+
+// The limit and the loss of the open candle, the extremes have been moved to it if there are candles within the
+// timeout.
+void QuickSample(fxlib::fprofit_mean_t profit, const fxlib::fxseries& ser, size_t iopen,
+                 const fxlib::fxsliding_extremes& extremes, bool has_closes, fxmargin_sample& limit,
+                 fxmargin_sample& loss) {
+    using namespace std;
+    const auto& minute = ser.minute;
+    const auto& means = ser.mean;
+    const double po = profit(means[iopen], means[iopen]);
+    limit = {po, 0};
+    loss = {-po, 0};
+    if (has_closes) {
+        // The profit depends on the close mean monotonically, so its extremes are at the extremes of the means.
+        size_t ilimit = extremes.max_index();
+        size_t iloss = extremes.min_index();
+        if (profit(means[ilimit], means[iopen]) < profit(means[iloss], means[iopen])) {
+            std::swap(ilimit, iloss);
+        }
+        const double p_limit = profit(means[ilimit], means[iopen]);
+        const double p_loss = profit(means[iloss], means[iopen]);
+        if (p_limit == p_loss) {
+            ilimit = iloss = (min)(ilimit, iloss);
+        }
+        if (limit.margin < p_limit) {
+            limit = {p_limit, static_cast<double>(minute[ilimit] - minute[iopen])};
+        }
+        if (loss.margin < -p_loss) {
+            loss = {-p_loss, static_cast<double>(minute[iloss] - minute[iopen])};
+        }
+    }
+    if (limit.margin < 0 || loss.margin < 0) {
+        throw logic_error("Something has gone wrong!");
+    }
+}
+
+// Processed candles are dropped from the window when there are at least so many of them and they take its half.
+const size_t fxMinWindowDrop = 1 << 16;
+
+// Dropping the first count candles of the window.
+void DropFront(fxlib::fxseries& window, size_t count) {
+    const auto drop = [count](auto& column) { column.erase(column.begin(), column.begin() + count); };
+    drop(window.time);
+    drop(window.minute);
+    drop(window.open);
+    drop(window.close);
+    drop(window.high);
+    drop(window.low);
+    drop(window.volume);
+    drop(window.mean);
+}
+
+// Pass over the quotes, the samples of every position with every timeout are given to add() in order of open time.
+/*
+  Quotes are read in batches into a window that holds the open candle and the candles within the longest timeout
+  after it, the passed candles are dropped, so the memory is bounded by the window instead of the whole sequence.
+*/
+template <typename Add>
+void QuickPass(fxlib::fxsequence_reader& reader, const std::vector<time_duration>& timeouts,
+               std::vector<std::vector<quick_samples>>& samples, Add add) {
+    using namespace std;
+    vector<fxlib::fxminutes> spans;
+    for (const auto& timeout : timeouts) {
+        spans.push_back(fxlib::ToMinutes(timeout));
+    }
+    const fxlib::fxminutes max_span = *max_element(spans.cbegin(), spans.cend());
+    fxlib::fxseries window = {reader.periodicity(), reader.period(), {}, {}, {}, {}, {}, {}, {}, {}};
+    // The extremes keep indices of the window, they are started over when the window is shifted.
+    vector<fxlib::fxsliding_extremes> extremes;
+    const auto start_extremes = [&]() {
+        extremes.clear();
+        extremes.reserve(timeouts.size());
+        for (const auto& timeout : timeouts) {
+            extremes.emplace_back(window, timeout);
+        }
+    };
+    start_extremes();
+    const auto& minute = window.minute;
+    // Sessions are mapped only when they are chosen, otherwise every candidate is counted.
+    boost::optional<fxlib::fxsession_map> sessions;
+    if (g_sessions) {
+        sessions.emplace(reader.period());
+    }
+    reader.rewind();
+    vector<fxlib::fxcandle> batch;
+    bool has_batches = true;
     int progress = 1;
-    size_t progress_idx = (progress * seq.candles.size()) / 10;
-    for (auto piter = seq.candles.begin();
-         piter < seq.candles.end() && piter->time <= (seq.candles.back().time - timeout); ++piter, ++curr_idx) {
-        if (curr_idx == progress_idx) {
-            cout << piter->time << " processed " << (progress * 10) << "%" << endl;
-            progress_idx = (++progress * seq.candles.size()) / 10;
-        }
-        if (prev_time.is_initialized()) {
-            const time_duration dt = piter->time - *prev_time;
-            min_adjust += dt.total_seconds() / 60.0;
-        }
-        prev_time = piter->time;
-        const double po = profit(*piter, *piter);
-        limits.push_back({po, 0});
-        losses.push_back({-po, 0});
-        for (auto citer = piter + 1; citer < seq.candles.end() && citer->time <= (piter->time + timeout); ++citer) {
-            const double p = profit(*citer, *piter);
-            if (limits.back().margin < p) {
-                limits.back() = {p, (citer->time - piter->time).total_seconds() / 60.0};
-            }
-            if (losses.back().margin < -p) {
-                losses.back() = {-p, (citer->time - piter->time).total_seconds() / 60.0};
+    size_t progress_idx = (progress * reader.size()) / 10;
+    const fxlib::fxminutes last_minute = fxlib::ToEpochMinutes(reader.last_time());
+    const fxlib::fxminutes last_open_minute = last_minute - *min_element(spans.cbegin(), spans.cend());
+    for (size_t iopen = 0, idx = 0;; ++iopen, ++idx) {
+        while (has_batches && (iopen >= window.size() || minute.back() < minute[iopen] + max_span)) {
+            has_batches = reader.next_batch(batch);
+            for (const auto& c : batch) {
+                window.push_back(c);
             }
         }
-        if (limits.back().margin < 0 || losses.back().margin < 0) {
-            throw logic_error("Something has gone wrong!");
+        if (iopen >= window.size() || minute[iopen] > last_open_minute) {
+            break;
+        }
+        if (iopen >= fxMinWindowDrop && 2 * iopen >= window.size()) {
+            DropFront(window, iopen);
+            iopen = 0;
+            start_extremes();
         }
-    }  // for seq.candles
-    if (limits.size() < 2 || losses.size() < 2 || limits.size() != losses.size()) {
+        if (idx == progress_idx) {
+            cout << window.time[iopen] << " processed " << (progress * 10) << "%" << endl;
+            progress_idx = (++progress * reader.size()) / 10;
+        }
+        const fxlib::fxsession_mask open_sessions = sessions ? sessions->mask(minute[iopen]) : 0;
+        if (sessions && (open_sessions & *g_sessions) == 0) {
+            continue;
+        }
+        for (size_t t = 0; t < timeouts.size(); t++) {
+            if (minute[iopen] > last_minute - spans[t]) {
+                continue;
+            }
+            const bool has_closes = extremes[t].open(iopen);
+            for (auto& s : samples[t]) {
+                fxmargin_sample limit;
+                fxmargin_sample loss;
+                QuickSample(s.profit, window, iopen, extremes[t], has_closes, limit, loss);
+                add(s, window.time[iopen], open_sessions, limit, loss);
+            }
+        }
+    }  // for window.time
+}
+
+void QuickReport(const variables_map& vm, const boost::gregorian::date_period& period, const quick_samples& samples) {
+    using namespace std;
+    const string& positon = samples.position;
+    const auto& session_N = samples.session_N;
+    const auto& session_limits = samples.session_limits;
+    const auto& session_losses = samples.session_losses;
+    if (samples.limits.count() < 2 || samples.losses.count() < 2 || samples.limits.count() != samples.losses.count()) {
         throw logic_error("No result");
     }
-    double lim_mean = 0;
-    double lim_var = 0;
-    fxlib::MarginStats(fxlib::fxsort(limits), lim_mean, lim_var);
-    double los_mean = 0;
-    double los_var = 0;
-    fxlib::MarginStats(fxlib::fxsort(losses), los_mean, los_var);
-    const size_t N = limits.size();
-    min_adjust /= (N - 1);
+    const double lim_mean = samples.limits.mean();
+    const double lim_var = samples.limits.variance();
+    const double los_mean = samples.losses.mean();
+    const double los_var = samples.losses.variance();
+    const size_t N = samples.limits.count();
+    // Mean open time between open candidates.
+    const fxlib::fxcalendar calendar(period);
+    const double min_adjust =
+        calendar.open_time(samples.first_open, samples.last_open).total_seconds() / 60.0 / (N - 1);
     boost::math::students_t dist(static_cast<double>(N - 1));
     const double T = boost::math::quantile(boost::math::complement(dist, g_alpha / 2));
     const double lim_w = T * lim_var / sqrt(static_cast<double>(N));
     const double los_w = T * los_var / sqrt(static_cast<double>(N));
     cout << "Done" << endl;
     cout << "----------------------------------" << endl;
-    const auto out_strs = PrepareOutputStrings(N, make_tuple(lim_mean / g_pip, lim_w / g_pip, lim_var / g_pip),
-                                               make_tuple(los_mean / g_pip, los_w / g_pip, los_var / g_pip));
+    auto out_strs = PrepareOutputStrings(N, make_tuple(lim_mean / g_pip, lim_w / g_pip, lim_var / g_pip),
+                                         make_tuple(los_mean / g_pip, los_w / g_pip, los_var / g_pip));
+    if (g_sessions) {
+        out_strs.push_back("Sessions (N, mean of Take Profit Limit and Stop-Loss):");
+    }
+    for (size_t k = 0; k < 4; k++) {
+        if (session_N[k] == 0) {
+            continue;
+        }
+        ostringstream ostr;
+        ostr << setw(10) << setfill(' ') << left << fxlib::conversion::session_to_string(session_list[k]) << right
+             << setw(10) << session_N[k] << fixed << setprecision(1) << setw(8)
+             << session_limits[k] / session_N[k] / g_pip << setw(8) << session_losses[k] / session_N[k] / g_pip;
+        out_strs.push_back(ostr.str());
+    }
     for (const auto& s : out_strs) {
         cout << s << endl;
     }
@@ -231,25 +378,29 @@ void QuickAnalyze(const variables_map& vm, const fxlib::fxsequence seq) {
         cout << "----------------------------------" << endl;
 
         cout << "Preparing distributions..." << endl;
-        const double mo = 0;
-        const double dm = 6 * (max)(lim_var, los_var) / g_distr_size;
-        const auto lim_distrib = BuildDistribution(limits, mo, dm, "limits");
-        const auto los_distrib = BuildDistribution(losses, mo, dm, "losses");
+        const fxlib::fxmargin_distributions lim = samples.limit_hist->distributions();
+        const fxlib::fxmargin_distributions los = samples.loss_hist->distributions();
+        const auto& lim_distrib = lim.distrib;
+        const auto& los_distrib = los.distrib;
+        CheckDistribution(lim_distrib, N, "limits");
+        CheckDistribution(los_distrib, N, "losses");
         if (lim_distrib.size() != los_distrib.size()) {
             throw logic_error("Size of limits distribution is not equal losses one!");
         }
         cout << "done" << endl;
         cout << "Preparing probabilities..." << endl;
-        const auto lim_probab = BuildProbability(limits, mo, dm, "limits");
+        const auto& lim_probab = lim.probab;
+        CheckProbability(lim_probab, N, "limits");
         const fxprobab_coefs lim_pcoefs = fxlib::ApproxMarginProbability(lim_probab);
-        const auto lim_durats = fxlib::MarginDurationDistribution(limits, g_distr_size, mo, dm);
+        const auto& lim_durats = lim.durats;
         const fxdurat_coefs lim_dcoefs = fxlib::ApproxDurationDistribution(lim_durats);
         if (lim_durats.size() != lim_probab.size()) {
             throw logic_error("Size of limits probability is not equal duration distribution one!");
         }
-        const auto los_probab = BuildProbability(losses, mo, dm, "losses");
+        const auto& los_probab = los.probab;
+        CheckProbability(los_probab, N, "losses");
         const fxprobab_coefs los_pcoefs = fxlib::ApproxMarginProbability(los_probab);
-        const auto los_durats = fxlib::MarginDurationDistribution(losses, g_distr_size, mo, dm);
+        const auto& los_durats = los.durats;
         const fxdurat_coefs los_dcoefs = fxlib::ApproxDurationDistribution(los_durats);
         if (los_durats.size() != los_probab.size()) {
             throw logic_error("Size of losses probability is not equal duration distribution one!");
@@ -264,15 +415,14 @@ void QuickAnalyze(const variables_map& vm, const fxlib::fxsequence seq) {
         cout << "done" << endl;
 
         boost::filesystem::path disp_file = g_outpath;
-        disp_file.append(g_srcbin.filename().stem().string() + "-quick-" + positon + "-" + vm["timeout"].as<string>() +
-                         ".gpl");
+        disp_file.append(g_srcbin.filename().stem().string() + "-quick-" + positon + "-" + samples.timeout + ".gpl");
         cout << "Writing " << disp_file << "..." << endl;
         ofstream fout(disp_file.string());
         if (!fout) {
             throw ios_base::failure("Could not open '" + g_outpath.string() + "'");
         }
-        fout << "# Profit limits and stop-losses for " << positon << " positon with " << vm["timeout"].as<string>()
-             << " timeout." << endl;
+        fout << "# Profit limits and stop-losses for " << positon << " positon with " << samples.timeout << " timeout."
+             << endl;
         for (const auto& s : out_strs) {
             fout << "# " << s << endl;
         }
@@ -340,6 +490,70 @@ void QuickAnalyze(const variables_map& vm, const fxlib::fxsequence seq) {
     }
 }
 
+// Samples of all the positions with all the timeouts are collected by a single pass, every timeout has its own
+// sliding extremes that are shared by the positions. The second pass is needed to build distributions for output.
+void QuickAnalyze(const variables_map& vm, fxlib::fxsequence_reader& reader) {
+    using namespace std;
+    vector<string> positions;
+    boost::algorithm::split(positions, boost::algorithm::to_lower_copy(vm["position"].as<string>()),
+                            boost::algorithm::is_any_of(","));
+    vector<string> timeout_names;
+    boost::algorithm::split(timeout_names, vm["timeout"].as<string>(), boost::algorithm::is_any_of(","));
+    vector<time_duration> timeouts;
+    vector<vector<quick_samples>> samples(timeout_names.size());
+    for (size_t t = 0; t < timeout_names.size(); t++) {
+        timeouts.push_back(fxlib::conversion::duration_from_string(timeout_names[t]));
+        for (const auto& positon : positions) {
+            cout << "Analyzing near " << reader.size() << " " << positon << " positions with " << timeouts[t]
+                 << " timeout..." << endl;
+            samples[t].push_back({positon, timeout_names[t], ProfitOf(positon), {}, {}, {}, {}, {}, {}, {}, {}, {}});
+        }
+    }
+    QuickPass(reader, timeouts, samples, [](quick_samples& s, const boost::posix_time::ptime& open_time,
+                                            fxlib::fxsession_mask open_sessions, const fxmargin_sample& limit,
+                                            const fxmargin_sample& loss) {
+        if (s.limits.count() == 0) {
+            s.first_open = open_time;
+        }
+        s.last_open = open_time;
+        s.limits.add(limit.margin);
+        s.losses.add(loss.margin);
+        for (size_t k = 0; k < 4; k++) {
+            if (open_sessions & session_list[k]) {
+                s.session_N[k]++;
+                s.session_limits[k] += limit.margin;
+                s.session_losses[k] += loss.margin;
+            }
+        }
+    });
+    if (vm.count("out")) {
+        cout << "Collecting distributions..." << endl;
+        for (auto& timeout_samples : samples) {
+            for (auto& s : timeout_samples) {
+                const double mo = 0;
+                const double dm = 6 * (max)(s.limits.variance(), s.losses.variance()) / g_distr_size;
+                s.limit_hist = fxmargin_histogram(g_distr_size, mo, dm);
+                s.loss_hist = fxmargin_histogram(g_distr_size, mo, dm);
+            }
+        }
+        QuickPass(reader, timeouts, samples,
+                  [](quick_samples& s, const boost::posix_time::ptime&, fxlib::fxsession_mask,
+                     const fxmargin_sample& limit, const fxmargin_sample& loss) {
+            s.limit_hist->add(limit);
+            s.loss_hist->add(loss);
+        });
+    }
+    for (const auto& timeout_samples : samples) {
+        for (const auto& s : timeout_samples) {
+            if (samples.size() * positions.size() > 1) {
+                cout << "==================================" << endl;
+                cout << s.position << " positions with " << s.timeout << " timeout" << endl;
+            }
+            QuickReport(vm, reader.period(), s);
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
     using namespace std;
     cout << "Forex Analyzer for distribution of limits and stop-losses" << endl;
@@ -353,27 +567,20 @@ int main(int argc, char* argv[]) {
         if (!vm.count("pip")) {
             throw invalid_argument("Unknown pip size for pair '" + g_srcbin.filename().stem().string() + "'");
         }
-        cout << "Reading " << g_srcbin << "..." << endl;
-        ifstream fbin(g_srcbin.string(), ifstream::binary);
-        if (!fbin) {
-            throw ios_base::failure("Could not open source file'" + g_srcbin.string() + "'");
-        }
-        const fxlib::fxsequence seq = fxlib::ReadSequence(fbin);
-        if (!fbin) {
-            throw ios_base::failure("Could not read source file'" + g_srcbin.string() + "'");
-        }
-        fbin.close();
-        if (seq.periodicity != minutes(1)) {
+        cout << "Opening " << g_srcbin << "..." << endl;
+        fxlib::fxsequence_reader reader(g_srcbin.string(), g_period);
+        if (reader.periodicity() != minutes(1)) {
             throw logic_error("Wrong sequence periodicity");
         }
-        if (seq.period.is_null()) {
+        if (reader.period().is_null()) {
             throw logic_error("Wrong sequence period");
         }
-        if (seq.candles.empty()) {
+        if (reader.empty()) {
             throw logic_error("No data was found in sequence");
         }
         if (vm.count("quick")) {
-            QuickAnalyze(vm, seq);
+            cout << "Reading " << reader.size() << " quotes..." << endl;
+            QuickAnalyze(vm, reader);
         }
     } catch (const system_error& e) {
         cout << "[ERROR] " << e.what() << endl;
@@ -1,5 +1,6 @@
 #include "fxlib/fxlib.h"
 #include "fxlib/helpers/program_options.h"
+#include "fxlib/helpers/string_conversion.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
@@ -15,10 +16,15 @@ bool g_search_mode = false;
 double g_threshold = 0;
 double g_take_profit = 0;
 double g_stop_loss = 0;
+// Sessions to filter candles, no filtering by default.
+boost::optional<fxlib::fxsession_mask> g_sessions;
 std::tuple<int, int> g_take_profit_range = {0, 0};
 std::tuple<int, int> g_stop_loss_range = {0, 0};
 std::tuple<double, double> g_threshold_range = {0, 0};
 double g_momentum = 0.3;
+// Days of quotes to be loaded, the whole sequence by default.
+boost::gregorian::date_period g_period(boost::gregorian::date(boost::date_time::min_date_time),
+                                       boost::gregorian::date(boost::date_time::max_date_time));
 
 std::tuple<int, int> irange_from_string(const std::string& str) {
     const boost::regex fmask("^(\\d+)-(\\d+)$");
@@ -38,6 +44,15 @@ std::tuple<double, double> drange_from_string(const std::string& str) {
     return {0, 0};
 }
 
+void SetFromDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(boost::gregorian::from_simple_string(str), g_period.end());
+}
+
+void SetToDate(const std::string& str) {
+    g_period = boost::gregorian::date_period(g_period.begin(),
+                                             boost::gregorian::from_simple_string(str) + boost::gregorian::days(1));
+}
+
 bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
     using namespace std;
     bool help = false;
@@ -55,13 +70,20 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
         "source,s", value<string>()->required()->value_name("bin")->notifier([](const string& srcname) {
             g_srcbin = boost::filesystem::canonical(srcname);
         }),
-        "Path to source binary quotes.");
+        "Path to source binary quotes.")(
+        "from", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetFromDate), "First day of quotes to load.")(
+        "to", value<string>()->value_name("yyyy-mm-dd")->notifier(&SetToDate), "Last day of quotes to load.");
     options_description quick_desc("Quick play options", 200);
     quick_desc.add_options()("profit,p", value<double>(&g_take_profit)->required()->value_name("pip"),
                              "Limit order for taking profit in pips.")(
         "loss,l", value<double>(&g_stop_loss)->required()->value_name("pip"),
         "Stop-loss order to limit losses in pips.")(
         "threshold,t", value<double>(&g_threshold)->required()->value_name("[0..1]"), "Threshold for making forecast.")(
+        "sessions", value<string>()->value_name("names")->notifier([](const string& names) {
+            g_sessions = fxlib::conversion::sessions_from_string(names);
+        }),
+        "Open positions only in the sessions (sydney,tokyo,london,newyork), at any time by default "
+        "(DST rules since 2001).")(
         "out,o", value<string>()->value_name("[filename]")->implicit_value("")->notifier([](const string& outname) {
             g_outtxt = boost::filesystem::canonical(outname);
         }),
@@ -16,9 +16,8 @@ extern double g_threshold;
 using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
 
-fxlib::fxsequence LoadingQuotes(const boost::filesystem::path& srcbin);
-bool IsWorseForOpen(fxlib::fxposition position, const fxlib::fxcandle& curr, const fxlib::fxcandle& worst);
-double Play(fxlib::IForecaster* forecaster, const fxlib::fxsequence& seq, fxlib::fxposition position,
+fxlib::fxseries LoadingQuotes(const boost::filesystem::path& srcbin);
+double Play(fxlib::IForecaster* forecaster, const fxlib::fxseries& ser, fxlib::fxposition position,
             const boost::posix_time::time_duration& timeout, const boost::posix_time::time_duration& window,
             double profit, double loss, double threshold, size_t* N, size_t* Np, double* sum_profit, size_t* Nl,
             double* sum_loss, double* sum_timeout);
@@ -37,7 +36,7 @@ void Full(const boost::property_tree::ptree& prop) {
     if (!forecaster) {
         throw invalid_argument("Could not create algorithm '" + g_algname + "'");
     }
-    const fxlib::fxsequence seq = LoadingQuotes(g_srcbin);
+    const fxlib::fxseries seq = LoadingQuotes(g_srcbin);
     const fxlib::ForecastInfo info = forecaster->Info();
     cout << "Playing algorithm " << g_algname << " with threshold " << g_threshold << "..." << endl;
     cout << "Position '" << (info.position == fxlib::fxposition::fxlong ? "long" : "short");
@@ -2,25 +2,43 @@
 
 #include <boost/filesystem.hpp>
 
-fxlib::fxsequence LoadingQuotes(const boost::filesystem::path& srcbin) {
+extern boost::gregorian::date_period g_period;
+
+fxlib::fxsequence_view MappingQuotes(const boost::filesystem::path& srcbin) {
     using namespace std;
-    cout << "Reading " << srcbin << "..." << endl;
-    ifstream fbin(srcbin.string(), ifstream::binary);
-    if (!fbin) {
-        throw ios_base::failure("Could not open source file'" + srcbin.string() + "'");
+    cout << "Mapping " << srcbin << "..." << endl;
+    const fxlib::fxsequence_view view(srcbin.string(), g_period);
+    if (view.periodicity() != boost::posix_time::minutes(1)) {
+        throw logic_error("Wrong sequence periodicity");
+    }
+    if (view.period().is_null()) {
+        throw logic_error("Wrong sequence period");
     }
-    const fxlib::fxsequence seq = fxlib::ReadSequence(fbin);
-    if (!fbin) {
-        throw ios_base::failure("Could not read source file'" + srcbin.string() + "'");
+    if (view.empty()) {
+        throw logic_error("No data was found in sequence");
     }
-    if (seq.periodicity != boost::posix_time::minutes(1)) {
+    return view;
+}
+
+fxlib::fxseries LoadingQuotes(const boost::filesystem::path& srcbin) {
+    using namespace std;
+    const fxlib::fxsequence_view view = MappingQuotes(srcbin);
+    cout << "Reading " << view.size() << " quotes..." << endl;
+    return fxlib::MakeSeries(view);
+}
+
+fxlib::fxsequence_reader OpeningQuotes(const boost::filesystem::path& srcbin) {
+    using namespace std;
+    cout << "Opening " << srcbin << "..." << endl;
+    fxlib::fxsequence_reader reader(srcbin.string(), g_period);
+    if (reader.periodicity() != boost::posix_time::minutes(1)) {
         throw logic_error("Wrong sequence periodicity");
     }
-    if (seq.period.is_null()) {
+    if (reader.period().is_null()) {
         throw logic_error("Wrong sequence period");
     }
-    if (seq.candles.empty()) {
+    if (reader.empty()) {
         throw logic_error("No data was found in sequence");
     }
-    return seq;
+    return reader;
 }
@@ -1,13 +1,14 @@
 #include "fxlib/fxlib.h"
 
-bool IsWorseForOpen(fxlib::fxposition position, const fxlib::fxcandle& curr, const fxlib::fxcandle& worst) {
+bool IsWorseForOpen(fxlib::fxposition position, const fxlib::fxminute_candle& curr,
+                    const fxlib::fxminute_candle& worst) {
     if (position == fxlib::fxposition::fxlong) {
         return curr.high > worst.high;
     }
     return curr.low < worst.low;
 }
 
-double Play(fxlib::IForecaster* forecaster, const fxlib::fxsequence& seq, fxlib::fxposition position,
+double Play(fxlib::IForecaster* forecaster, const fxlib::fxseries& ser, fxlib::fxposition position,
             const boost::posix_time::time_duration& timeout, const boost::posix_time::time_duration& window,
             double profit, double loss, double threshold, size_t* N, size_t* Np, double* sum_profit, size_t* Nl,
             double* sum_loss, double* sum_timeout) {
@@ -20,29 +21,33 @@ double Play(fxlib::IForecaster* forecaster, const fxlib::fxsequence& seq, fxlib:
         *Np = 0;
     if (Nl)
         *Nl = 0;
-    for (auto piter = seq.candles.cbegin();
-         piter < seq.candles.cend() && piter->time <= (seq.candles.back().time - timeout - window); ++piter) {
-        const double est = forecaster->Feed(*piter);
+    const bool is_long = position == fxlib::fxposition::fxlong;
+    // Only one price column is needed to open and the opposite one to close the position.
+    const std::vector<double>& open_prices = is_long ? ser.high : ser.low;
+    const std::vector<double>& close_prices = is_long ? ser.low : ser.high;
+    const auto& times = ser.minute;
+    const fxlib::fxminutes timeout_span = fxlib::ToMinutes(timeout);
+    const fxlib::fxminutes window_span = fxlib::ToMinutes(window);
+    const size_t size = ser.size();
+    for (size_t p = 0; p < size && times[p] <= (times.back() - timeout_span - window_span); ++p) {
+        const double est = forecaster->Feed(ser.candle(p));
         if (est >= threshold) {
             if (N)
                 ++(*N);
             // Finding the worst case to open position in window
-            auto iopen = piter;
-            for (auto iter = piter + 1; iter->time < (piter->time + window); ++iter) {
-                if (IsWorseForOpen(position, *iter, *iopen)) {
-                    iopen = iter;
+            size_t iopen = p;
+            for (size_t i = p + 1; times[i] < (times[p] + window_span); ++i) {
+                if (is_long ? open_prices[i] > open_prices[iopen] : open_prices[i] < open_prices[iopen]) {
+                    iopen = i;
                 }
             }
             // Shift progress to open position
-            while (piter < iopen) {
-                ++piter;
-            }
+            p = iopen;
             // Open position and await result
-            const double open_rate = (position == fxlib::fxposition::fxlong) ? iopen->high : iopen->low;
+            const double open_rate = open_prices[iopen];
             bool trigged = false;
-            for (; piter->time <= (iopen->time + timeout); ++piter) {
-                const double margin =
-                    (position == fxlib::fxposition::fxlong) ? piter->low - open_rate : open_rate - piter->high;
+            for (; times[p] <= (times[iopen] + timeout_span); ++p) {
+                const double margin = is_long ? close_prices[p] - open_rate : open_rate - close_prices[p];
                 if (margin >= profit) {
                     if (Np)
                         ++(*Np);
@@ -58,8 +63,7 @@ double Play(fxlib::IForecaster* forecaster, const fxlib::fxsequence& seq, fxlib:
                 }
             }
             if (!trigged) {
-                const double margin =
-                    (position == fxlib::fxposition::fxlong) ? piter->low - open_rate : open_rate - piter->high;
+                const double margin = is_long ? close_prices[p] - open_rate : open_rate - close_prices[p];
                 stimeout += margin;
             }
         }
@@ -4,6 +4,8 @@
 
 #include <boost/filesystem.hpp>
 
+#include <deque>
+
 extern boost::filesystem::path g_srcbin;
 extern boost::filesystem::path g_outtxt;
 extern boost::filesystem::path g_config;
@@ -12,12 +14,14 @@ extern double g_take_profit;
 extern double g_stop_loss;
 extern double g_pip;
 extern double g_threshold;
+extern boost::optional<fxlib::fxsession_mask> g_sessions;
 
 using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
 
-fxlib::fxsequence LoadingQuotes(const boost::filesystem::path& srcbin);
-bool IsWorseForOpen(fxlib::fxposition position, const fxlib::fxcandle& curr, const fxlib::fxcandle& worst);
+fxlib::fxsequence_reader OpeningQuotes(const boost::filesystem::path& srcbin);
+bool IsWorseForOpen(fxlib::fxposition position, const fxlib::fxminute_candle& curr,
+                    const fxlib::fxminute_candle& worst);
 
 void Quick(const boost::property_tree::ptree& prop, bool out) {
     using namespace std;
@@ -35,7 +39,7 @@ void Quick(const boost::property_tree::ptree& prop, bool out) {
     if (!forecaster) {
         throw invalid_argument("Could not create algorithm '" + g_algname + "'");
     }
-    const fxlib::fxsequence seq = LoadingQuotes(g_srcbin);
+    fxlib::fxsequence_reader reader = OpeningQuotes(g_srcbin);
     const fxlib::ForecastInfo info = forecaster->Info();
     cout << "Playing algorithm " << g_algname << " with threshold " << g_threshold << "..." << endl;
     cout << "Position '" << (info.position == fxlib::fxposition::fxlong ? "long" : "short") << "' with take-profit "
@@ -47,37 +51,59 @@ void Quick(const boost::property_tree::ptree& prop, bool out) {
     double sum_profit = 0;
     double sum_loss = 0;
     double sum_timeout = 0;
-    fxlib::helpers::progress progress(seq.candles.size(), cout);
-    for (auto piter = seq.candles.cbegin();
-         piter < seq.candles.cend() && piter->time <= (seq.candles.back().time - info.timeout - info.window); ++piter) {
-        progress(piter - seq.candles.cbegin());
-        const double est = forecaster->Feed(*piter);
-        if (est >= g_threshold) {
+    // Candles are read ahead as far as the window and timeout need, the passed ones are released.
+    std::deque<fxlib::fxminute_candle> candles;
+    size_t first_idx = 0;  // of candles.front() in the sequence
+    vector<fxlib::fxminute_candle> batch;
+    const auto candle = [&](size_t idx) -> const fxlib::fxminute_candle& {
+        while (idx - first_idx >= candles.size()) {
+            if (!reader.next_batch(batch)) {
+                throw out_of_range("Candle index is out of the sequence.");
+            }
+            for (const auto& c : batch) {
+                candles.push_back(c);
+            }
+        }
+        return candles[idx - first_idx];
+    };
+    const fxlib::fxsession_filter sessions(reader.period(), g_sessions);
+    fxlib::helpers::progress progress(reader.size(), cout);
+    const fxlib::fxminutes timeout = fxlib::ToMinutes(info.timeout);
+    const fxlib::fxminutes window = fxlib::ToMinutes(info.window);
+    const fxlib::fxminutes last_time = fxlib::ToEpochMinutes(reader.last_time()) - timeout - window;
+    for (size_t p = 0; p < reader.size() && candle(p).time <= last_time; ++p) {
+        for (; first_idx < p; ++first_idx) {
+            candles.pop_front();
+        }
+        progress(p);
+        const fxlib::fxminute_candle curr = candle(p);
+        const double est = forecaster->Feed(fxlib::FromMinuteCandle(curr));
+        if (est >= g_threshold && sessions.accepts(curr.time)) {
             N++;
             if (flog.is_open()) {
-                flog << setfill(' ') << setw(6) << N << " " << piter->time << " ";
+                flog << setfill(' ') << setw(6) << N << " " << fxlib::FromEpochMinutes(curr.time) << " ";
             }
             // Finding the worst case to open position in window
-            auto iopen = piter;
-            for (auto iter = piter + 1; iter->time < (piter->time + info.window); ++iter) {
-                if (IsWorseForOpen(info.position, *iter, *iopen)) {
-                    iopen = iter;
+            size_t iopen = p;
+            for (size_t i = p + 1; candle(i).time < (curr.time + window); ++i) {
+                if (IsWorseForOpen(info.position, candle(i), candle(iopen))) {
+                    iopen = i;
                 }
             }
+            const fxlib::fxminute_candle open = candle(iopen);
             if (flog.is_open()) {
-                flog << iopen->time << fixed << setprecision(3) << setw(8) << iopen->high << setw(8) << iopen->low
-                     << " ";
+                flog << fxlib::FromEpochMinutes(open.time) << fixed << setprecision(3) << setw(8) << open.high << setw(8)
+                     << open.low << " ";
             }
             // Shift progress to open position
-            while (piter < iopen) {
-                ++piter;
-            }
+            p = iopen;
             // Open position and await result
-            const double open_rate = (info.position == fxlib::fxposition::fxlong) ? iopen->high : iopen->low;
+            const double open_rate = (info.position == fxlib::fxposition::fxlong) ? open.high : open.low;
             bool trigged = false;
-            for (; piter->time <= (iopen->time + info.timeout); ++piter) {
+            for (; candle(p).time <= (open.time + timeout); ++p) {
+                const fxlib::fxminute_candle& close = candle(p);
                 const double margin =
-                    (info.position == fxlib::fxposition::fxlong) ? piter->low - open_rate : open_rate - piter->high;
+                    (info.position == fxlib::fxposition::fxlong) ? close.low - open_rate : open_rate - close.high;
                 if (margin >= g_take_profit * g_pip) {
                     Np++;
                     sum_profit += margin;
@@ -97,8 +123,9 @@ void Quick(const boost::property_tree::ptree& prop, bool out) {
                 }
             }
             if (!trigged) {
+                const fxlib::fxminute_candle& close = candle(p);
                 const double margin =
-                    (info.position == fxlib::fxposition::fxlong) ? piter->low - open_rate : open_rate - piter->high;
+                    (info.position == fxlib::fxposition::fxlong) ? close.low - open_rate : open_rate - close.high;
                 sum_timeout += margin;
                 if (flog.is_open()) {
                     flog << setw(8) << "timeout" << fixed << setprecision(1) << setw(8) << margin / g_pip;
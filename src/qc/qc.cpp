@@ -10,21 +10,25 @@
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
 #include <boost/optional.hpp>
+#include <boost/crc.hpp>
 
 #include <vector>
 #include <string>
 #include <tuple>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <iterator>
+#include <map>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <ctime>
+#include <thread>
 
 using fxlib::conversion::string_narrow;
 using fxlib::conversion::string_widen;
 
-using boost::posix_time::hours;
 using boost::posix_time::minutes;
 using boost::posix_time::ptime;
 using boost::posix_time::time_duration;
@@ -35,16 +39,259 @@ using boost::gregorian::date_period;
 using boost::gregorian::from_undelimited_string;
 using boost::gregorian::to_simple_string;
 
-time_duration CalcLongGap(const ptime& last_time, const boost::gregorian::date& date) {
-    const boost::gregorian::date last_date = (last_time - minutes(1)).date();
-    time_duration delta = (last_date.day_of_week() == boost::gregorian::Saturday)
-                              ? minutes(0)
-                              : (ptime(last_date, hours(24)) - last_time);
-    boost::gregorian::day_iterator ditr{last_date};
-    for (++ditr; ditr < date; ++ditr) {
-        delta += fxlib::ForexOpenHours(*ditr).length();
+// Candles of a source file with messages that are shown when the file is merged.
+struct source_quotes {
+    std::vector<fxlib::fxcandle> candles;
+    bool kept = false;   // the candles are taken from the existing binary file
+    int first_line = 0;  // of the first candle, zero when it is unknown
+    int line_count = 0;
+    std::string log;
+    boost::optional<std::string> error;
+};
+
+// Reading of a source file, the gaps (open time between candles) are checked inside of the file only. Days before
+// append_from are skipped.
+source_quotes ParseSource(const boost::filesystem::path& src_file, const date_period& file_period,
+                          const std::string& pair_name, bool warning, const time_duration& allowable_gap,
+                          const fxlib::fxcalendar& calendar,
+                          const boost::optional<boost::gregorian::date>& append_from) {
+    using namespace std;
+    source_quotes src;
+    ostringstream log;
+    try {
+        // Open source file and check header
+        const string fullfilename = string_narrow(src_file.c_str());
+        ifstream fin(fullfilename);
+        int& line_count = src.line_count;
+        if (fin.good()) {
+            string header;
+            if (!getline(fin, header).good()) {
+                throw "Could not read the header from " + fullfilename;
+            } else if (header != "<TICKER> <PER> <DATE> <TIME> <OPEN> <HIGH> <LOW> <CLOSE> <VOL>") {
+                throw "The header is mismatched in " + fullfilename;
+            }
+            line_count++;  // The header has been read.
+        } else {
+            throw "Could not open " + fullfilename;
+        }
+
+        bool empty = true;
+        boost::optional<ptime> previous_time;
+        string line;
+        while (!fin.eof()) {
+            line_count++;
+            try {
+                // Read line
+                getline(fin, line);
+                if (fin.bad()) {
+                    throw std::logic_error("Read error!");
+                }
+                if (line.empty() && fin.eof()) {
+                    break;
+                }
+                // It assumes that an empty line is not supported in the source files.
+                const fxlib::fxcandle candle = fxlib::MakeFromFinam(line, pair_name);
+                empty = false;
+                // Test parsed candle data
+                if (candle.volume == 0) {
+                    throw std::logic_error("Empty candle volume");
+                }
+                const boost::gregorian::date curr_date = (candle.time - minutes(1)).date();
+                if (append_from.is_initialized() && curr_date < *append_from) {
+                    // The day has been already stored.
+                    continue;
+                }
+                if (warning && curr_date >= file_period.end()) {
+                    log << "[WARN] Line:" << line_count
+                        << " - extra data that is out of file period " + to_simple_string(file_period)
+                        << ". All further data will be skipped!" << endl;
+                    break;
+                }
+                if (previous_time.is_initialized()) {
+                    if (candle.time <= *previous_time) {
+                        throw std::logic_error("Wrong candle time " + to_simple_string(candle.time) +
+                                               " that is less or equal previous time " +
+                                               to_simple_string(*previous_time));
+                    }
+                    // Candles out of the file period are accepted without warnings, the calendar does not cover them.
+                    if (warning) {
+                        const time_duration delta = calendar.open_time(*previous_time, candle.time);
+                        if (delta >= allowable_gap) {
+                            log << "[INFO] Line: " << line_count << " - Gap " << delta << endl;
+                        }
+                    }
+                } else {
+                    src.first_line = line_count;
+                }
+                previous_time = candle.time;
+                if (warning && !calendar.is_open(candle.time)) {
+                    log << "[WARN] Line: " << line_count << " - Candle date-time " << candle.time
+                        << " is out of open period " << fxlib::ForexOpenHours(curr_date) << endl;
+                }
+
+                src.candles.push_back(candle);
+            } catch (const std::exception& e) {
+                ostringstream ostr;
+                ostr << "Line: " << line_count << " - " << e.what();
+                throw ostr.str();
+            }
+        }  // while !fin.eof()
+
+        if (empty) {
+            throw string("File is empty!");
+        }
+    } catch (const string& e) {
+        src.error = e;
+    } catch (const exception& e) {
+        src.error = string(e.what());
+    }
+    src.log = log.str();
+    return src;
+}
+
+// Reading of the source files by a pool of threads, the results are in order of the files.
+std::vector<source_quotes> ParseSources(const std::vector<std::tuple<boost::filesystem::path, date_period>>& src_list,
+                                        const std::string& pair_name, bool warning, const time_duration& allowable_gap,
+                                        const fxlib::fxcalendar& calendar,
+                                        const boost::optional<boost::gregorian::date>& append_from, unsigned jobs) {
+    std::vector<source_quotes> sources(src_list.size());
+    std::atomic<size_t> next{0};
+    const auto parse = [&]() {
+        for (size_t i = next++; i < src_list.size(); i = next++) {
+            sources[i] = ParseSource(std::get<0>(src_list[i]), std::get<1>(src_list[i]), pair_name, warning,
+                                     allowable_gap, calendar, append_from);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned j = 1; j < std::min<size_t>(jobs, src_list.size()); j++) {
+        pool.emplace_back(parse);
+    }
+    parse();
+    for (auto& worker : pool) {
+        worker.join();
+    }
+    return sources;
+}
+
+// Source file of a binary file, a change is detected by its size, time and hash of content.
+struct manifest_entry {
+    uintmax_t size;
+    std::time_t mtime;
+    uint32_t crc;
+    size_t first;  // candle that has been read from the source
+    size_t count;
+};
+
+uint32_t HashFile(const boost::filesystem::path& file) {
+    std::ifstream fin(string_narrow(file.c_str()), std::ifstream::binary);
+    if (!fin) {
+        throw "Could not open " + string_narrow(file.c_str());
+    }
+    boost::crc_32_type crc;
+    std::vector<char> buf(1 << 16);
+    while (fin.read(buf.data(), buf.size()) || fin.gcount() > 0) {
+        crc.process_bytes(buf.data(), static_cast<size_t>(fin.gcount()));
+    }
+    return crc.checksum();
+}
+
+// The time is trusted only when it is older than the manifest, a file could be changed in the same second after it
+// has been read.
+bool IsSameSource(const boost::filesystem::path& file, const manifest_entry& entry, std::time_t manifest_time) {
+    if (boost::filesystem::file_size(file) != entry.size) {
+        return false;
     }
-    return delta;
+    const std::time_t mtime = boost::filesystem::last_write_time(file);
+    return (mtime == entry.mtime && mtime < manifest_time) || HashFile(file) == entry.crc;
+}
+
+// Every line of a manifest is "filename size mtime crc first count".
+std::map<std::string, manifest_entry> ReadManifest(const boost::filesystem::path& manifest_path) {
+    std::map<std::string, manifest_entry> manifest;
+    std::ifstream fin(string_narrow(manifest_path.c_str()));
+    std::string line;
+    while (std::getline(fin, line)) {
+        std::istringstream in(line);
+        std::string filename;
+        manifest_entry entry;
+        if (!(in >> filename >> entry.size >> entry.mtime >> std::hex >> entry.crc >> std::dec >> entry.first >>
+              entry.count)) {
+            throw "The manifest " + string_narrow(manifest_path.c_str()) + " is corrupted";
+        }
+        manifest[filename] = entry;
+    }
+    return manifest;
+}
+
+// Sources are mapped to candles of the binary file by their periods, hashes of unchanged sources are not computed
+// again.
+void WriteManifest(const boost::filesystem::path& manifest_path,
+                   const std::vector<std::tuple<boost::filesystem::path, date_period>>& sources,
+                   const fxlib::fxsequence_view& view, const std::map<std::string, manifest_entry>& manifest) {
+    const auto before = [](const ptime& time, const fxlib::fxcandle& candle) { return time < candle.time; };
+    std::ofstream fout(string_narrow(manifest_path.c_str()), std::ofstream::trunc);
+    for (const auto& src : sources) {
+        const boost::filesystem::path& file = std::get<0>(src);
+        const date_period& period = std::get<1>(src);
+        if (!view.period().contains(period)) {
+            continue;
+        }
+        const std::string filename = string_narrow(file.filename().c_str());
+        manifest_entry entry;
+        entry.size = boost::filesystem::file_size(file);
+        entry.mtime = boost::filesystem::last_write_time(file);
+        const auto old = manifest.find(filename);
+        entry.crc = (old != manifest.end() && old->second.size == entry.size && old->second.mtime == entry.mtime)
+                        ? old->second.crc
+                        : HashFile(file);
+        const auto first = std::upper_bound(view.begin(), view.end(), ptime(period.begin()), before);
+        const auto last = std::upper_bound(first, view.end(), ptime(period.end()), before);
+        entry.first = static_cast<size_t>(first - view.begin());
+        entry.count = static_cast<size_t>(last - first);
+        fout << filename << " " << entry.size << " " << entry.mtime << " " << std::hex << entry.crc << std::dec << " "
+             << entry.first << " " << entry.count << std::endl;
+    }
+    if (!fout) {
+        throw "Could not write the manifest " + string_narrow(manifest_path.c_str());
+    }
+}
+
+// Candles of an unchanged source are taken from the binary file.
+source_quotes KeepSource(const fxlib::fxsequence_view& view, const date_period& period, const manifest_entry& entry) {
+    source_quotes src;
+    src.kept = true;
+    if (entry.first + entry.count > view.size()) {
+        throw std::string("The binary file does not match its manifest, it should be rewritten.");
+    }
+    src.candles.reserve(entry.count);
+    for (size_t i = entry.first; i < entry.first + entry.count; i++) {
+        const fxlib::fxcandle candle = view[i];
+        if (candle.time <= ptime(period.begin()) || candle.time > ptime(period.end())) {
+            throw std::string("The binary file does not match its manifest, it should be rewritten.");
+        }
+        src.candles.push_back(candle);
+    }
+    return src;
+}
+
+// Packing the quotes as they are stored in the binary file (prices in millionths, volumes cut to 16 bits), so the
+// pyramid is the same as the stored quotes are packed into.
+fxlib::fxpyramid PackStoredQuotes(const boost::filesystem::path& out_path, const std::vector<time_duration>& periods) {
+    fxlib::fxsequence_reader reader(string_narrow(out_path.c_str()));
+    return fxlib::fxpyramid(reader, periods);
+}
+
+// Packing the quotes of the binary file and storing them after the minute ones.
+int StorePyramid(const boost::filesystem::path& out_path, const std::vector<time_duration>& periods) {
+    using namespace std;
+    try {
+        cout << "Packing " << periods.size() << " levels of the pyramid to " << out_path << "..." << endl;
+        fxlib::WritePyramid(string_narrow(out_path.c_str()), PackStoredQuotes(out_path, periods));
+    } catch (const exception& e) {
+        cout << "[ERROR] " << e.what() << endl;
+        return boost::system::errc::io_error;
+    }
+    return boost::system::errc::success;
 }
 
 bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
@@ -57,7 +304,12 @@ bool TryParseCommandLine(int argc, char* argv[], variables_map& vm) {
         "pair,p", value<string>()->required()->value_name("pair-name"), "Quotation pair name.")(
         "out,o", value<string>()->value_name("out-file"), "Filename to binary output, 'pair-name.bin' by default.");
     options_description additional_desc("Additional options", 200);
-    additional_desc.add_options()("rewrite,r", "Rewrite existing output file.")(
+    additional_desc.add_options()("rewrite,r", "Rewrite existing output file and its manifest.")(
+        "append,a", "Append quotes of new source files to existing output file.")(
+        "compress,c", "Write compressed binary output (format v2).")(
+        "pyramid,y", "Store quotes packed to 5m, 15m, 30m, 1h and 4h after the minute ones.")(
+        "jobs,j", value<unsigned>()->value_name("num")->default_value(0),
+        "Number of threads to read source files, 0 - by number of cores.")(
         "gap,g", value<int>()->value_name("min")->default_value(60),
         "Allowable gap in minutes, 0 - to suppress informing.")(
         "warn,w", value<string>()->value_name("on/off")->default_value("on")->implicit_value("on"), "Show warnings.");
@@ -115,13 +367,51 @@ int main(int argc, char* argv[]) {
     }
     out_path.append(out_file.filename().c_str());
 
+    // Sources of the binary file are listed in its manifest.
+    const boost::filesystem::path manifest_path = boost::filesystem::path(out_path).replace_extension(".manifest");
     if (vm.count("rewrite")) {
         boost::filesystem::remove(out_path);
+        boost::filesystem::remove(manifest_path);
     }
+    // Stored period end and last candle time when quotes are appended to the existing file.
+    boost::optional<tuple<boost::gregorian::date, ptime>> stored;
+    // Format of the existing file when it is updated by changed sources.
+    boost::optional<fxlib::fxformat> stored_format;
+    map<string, manifest_entry> manifest;
+    // Periods of the pyramid to be stored, the stored one is kept up to date.
+    vector<time_duration> pyramid_periods;
+    bool stored_pyramid = false;
     if (boost::filesystem::exists(out_path)) {
-        // TODO: add hash checking to be sure that really nothing to do.
-        cout << "[NOTE] The binary file " << out_path << " already exists. Nothing to do." << endl;
-        return boost::system::errc::success;
+        try {
+            if (boost::filesystem::exists(manifest_path)) {
+                manifest = ReadManifest(manifest_path);
+            }
+        } catch (const string& e) {
+            cout << "[ERROR] " << e << endl;
+            return boost::system::errc::io_error;
+        }
+        if (!vm.count("append") && manifest.empty()) {
+            cout << "[NOTE] The binary file " << out_path << " already exists without a manifest. Nothing to do."
+                 << endl;
+            return boost::system::errc::success;
+        }
+        try {
+            const fxlib::fxsequence_reader reader(string_narrow(out_path.c_str()));
+            if (vm.count("append")) {
+                stored = make_tuple(reader.period().end(), reader.last_time());
+            } else {
+                stored_format = reader.format();
+            }
+            pyramid_periods = fxlib::ReadPyramidPeriods(string_narrow(out_path.c_str()));
+            stored_pyramid = !pyramid_periods.empty();
+        } catch (const exception& e) {
+            cout << "[ERROR] Could not open the binary file " << out_path << ": " << e.what() << endl;
+            return boost::system::errc::io_error;
+        }
+    }
+
+    if (vm.count("pyramid")) {
+        pyramid_periods = fxlib::fxpyramid::default_periods();
     }
 
     const minutes allowable_gap{vm["gap"].as<int>()};
@@ -131,9 +421,16 @@ int main(int argc, char* argv[]) {
         return boost::system::errc::invalid_argument;
     }
 
-    cout << "Compile all [" << pair_name << "]-files in " << src_path << " to binary file " << out_path << endl;
+    if (stored.is_initialized()) {
+        cout << "Append [" << pair_name << "]-files in " << src_path << " from " << get<0>(*stored)
+             << " to binary file " << out_path << endl;
+    } else if (stored_format.is_initialized()) {
+        cout << "Update [" << pair_name << "]-files in " << src_path << " to binary file " << out_path << endl;
+    } else {
+        cout << "Compile all [" << pair_name << "]-files in " << src_path << " to binary file " << out_path << endl;
+    }
 
-    vector<tuple<boost::filesystem::path, date_period>> src_list;
+    vector<tuple<boost::filesystem::path, date_period>> all_sources;
 
     const boost::regex fmask("^" + pair_name + "_([0-9]{6})_([0-9]{6})\\.txt$");
     for (auto entry : boost::make_iterator_range(boost::filesystem::directory_iterator(src_path), {})) {
@@ -144,18 +441,37 @@ int main(int argc, char* argv[]) {
                 const date_period period(
                     from_undelimited_string("20" + what[1].str()),
                     from_undelimited_string("20" + what[2].str()) + boost::gregorian::date_duration(1));
-                src_list.push_back(make_tuple(entry.path(), period));
+                all_sources.push_back(make_tuple(entry.path(), period));
             }
         }
     }
+    sort(begin(all_sources), end(all_sources), [](const auto& a, const auto& b) { return get<1>(a) < get<1>(b); });
 
+    vector<tuple<boost::filesystem::path, date_period>> src_list;
+    for (const auto& src : all_sources) {
+        date_period period = get<1>(src);
+        if (stored.is_initialized()) {
+            // Only days after the stored period are compiled.
+            if (period.end() <= get<0>(*stored)) {
+                continue;
+            }
+            period = date_period(max(period.begin(), get<0>(*stored)), period.end());
+        }
+        src_list.push_back(make_tuple(get<0>(src), period));
+    }
+
+    if (src_list.empty() && stored.is_initialized()) {
+        cout << "[NOTE] No one source file is newer than the binary file " << out_path << ". Nothing to do." << endl;
+        if (!stored_pyramid && !pyramid_periods.empty()) {
+            return StorePyramid(out_path, pyramid_periods);
+        }
+        return boost::system::errc::success;
+    }
     if (src_list.empty()) {
         cout << "[ERROR] No one source file has been found!" << endl;
         return boost::system::errc::no_such_file_or_directory;
     }
 
-    sort(begin(src_list), end(src_list), [](const auto& a, const auto& b) { return get<1>(a) < get<1>(b); });
-
     date_period total_period = get<1>(src_list[0]);
     for (size_t i = 1; i < src_list.size(); i++) {
         if (total_period.is_adjacent(get<1>(src_list[i]))) {
@@ -166,125 +482,145 @@ int main(int argc, char* argv[]) {
             return boost::system::errc::argument_out_of_domain;
         }
     }
+    if (stored.is_initialized() && total_period.begin() != get<0>(*stored)) {
+        cout << "[ERROR] There is a gap between the binary file " << out_path << " and " << get<0>(src_list[0])
+             << endl;
+        return boost::system::errc::argument_out_of_domain;
+    }
     cout << "Found " << src_list.size() << " source files with total period " << total_period << endl;
 
     fxlib::fxsequence seq = {minutes(1), total_period, {}};
-    size_t min_count = 0;
-    for (boost::gregorian::day_iterator ditr = {total_period.begin()}; ditr < total_period.end(); ++ditr) {
-        const time_period open_period = fxlib::ForexOpenHours(*ditr);
-        min_count += open_period.length().total_seconds() / 60;
+    // The calendar starts from the stored last candle to check the gap after it.
+    boost::gregorian::date calendar_begin = total_period.begin();
+    if (stored.is_initialized() && !get<1>(*stored).is_special()) {
+        calendar_begin = min(calendar_begin, (get<1>(*stored) - minutes(1)).date());
     }
+    const fxlib::fxcalendar calendar(date_period(calendar_begin, total_period.end()));
+    const size_t min_count = calendar.open_time(total_period).total_seconds() / 60;
     seq.candles.reserve(min_count);
     cout << "Expected total " << min_count << " minutely quotes" << endl;
 
     try {
-        for (const auto& src : src_list) {
-            // Open source file and check header
-            const string fullfilename = string_narrow(get<0>(src).c_str());
-            ifstream fin(fullfilename);
-            int line_count = 0;
-            if (fin.good()) {
-                string header;
-                if (!getline(fin, header).good()) {
-                    throw "Could not read the header from " + fullfilename;
-                } else if (header != "<TICKER> <PER> <DATE> <TIME> <OPEN> <HIGH> <LOW> <CLOSE> <VOL>") {
-                    throw "The header is mismatched in " + fullfilename;
+        // Sources that have not been changed since the binary file was written are not read again.
+        vector<bool> kept(src_list.size(), false);
+        if (stored_format.is_initialized()) {
+            const time_t manifest_time = boost::filesystem::last_write_time(manifest_path);
+            for (size_t i = 0; i < src_list.size(); i++) {
+                const auto entry = manifest.find(string_narrow(get<0>(src_list[i]).filename().c_str()));
+                kept[i] = entry != manifest.end() && IsSameSource(get<0>(src_list[i]), entry->second, manifest_time);
+            }
+            if (manifest.size() == src_list.size() && all_of(kept.begin(), kept.end(), [](bool k) { return k; })) {
+                cout << "[NOTE] Sources of the binary file " << out_path << " have not been changed. Nothing to do."
+                     << endl;
+                // Times of the touched sources are updated.
+                WriteManifest(manifest_path, all_sources, fxlib::fxsequence_view(string_narrow(out_path.c_str())),
+                              manifest);
+                if (!stored_pyramid && !pyramid_periods.empty()) {
+                    return StorePyramid(out_path, pyramid_periods);
                 }
-                line_count++;  // The header has been read.
-            } else {
-                throw "Could not open " + fullfilename;
+                return boost::system::errc::success;
             }
-
-            const date_period& file_period = get<1>(src);
-            boost::optional<ptime> previous_time;
-
-            cout << "Reading " << fullfilename << " " << file_period << "..." << endl;
-            while (!fin.eof()) {
-                line_count++;
-                try {
-                    // Read line
-                    string line;
-                    getline(fin, line);
-                    if (fin.bad()) {
-                        throw std::logic_error("Read error!");
-                    }
-                    if (line.empty() && fin.eof()) {
-                        break;
-                    }
-                    // It assumes that an empty line is not supported in the source files.
-                    const fxlib::fxcandle candle = fxlib::MakeFromFinam(line, pair_name);
-                    // Test parsed candle data
-                    if (candle.volume == 0) {
-                        throw std::logic_error("Empty candle volume");
-                    }
-                    const boost::gregorian::date curr_date = (candle.time - minutes(1)).date();
-                    if (warning && curr_date >= file_period.end()) {
-                        cout << "[WARN] Line:" << line_count
-                             << " - extra data that is out of file period " + to_simple_string(file_period)
-                             << ". All further data will be skipped!" << endl;
-                        break;
-                    }
-                    time_duration delta;
-                    if (previous_time.is_initialized()) {
-                        if (candle.time <= *previous_time) {
-                            throw std::logic_error("Wrong candle time " + to_simple_string(candle.time) +
-                                                   " that is less or equal previous time " +
-                                                   to_simple_string(*previous_time));
-                        }
-                        delta = candle.time - *previous_time;
-                        const boost::gregorian::date prev_date = (*previous_time - minutes(1)).date();
-                        if ((delta > minutes(1)) && (curr_date > prev_date)) {
-                            delta = CalcLongGap(*previous_time, curr_date);
-                            if (curr_date.day_of_week() != boost::gregorian::Sunday) {
-                                delta += candle.time - ptime(curr_date);
-                            }
-                        }     // if ((delta > minutes(1)) && (candle.time.date() > previous_time->date()))
-                    } else {  // if (previous_time.is_initialized())
-                        delta = curr_date > file_period.begin()
-                                    ? CalcLongGap(ptime(file_period.begin()) + minutes(1), curr_date)
-                                    : minutes(0);
-                        if (curr_date.day_of_week() != boost::gregorian::Sunday) {
-                            delta += candle.time - ptime(curr_date);
-                        }
-                    }
-                    if (warning && delta >= allowable_gap) {
-                        cout << "[INFO] Line: " << line_count << " - Gap " << delta << endl;
-                    }
-                    previous_time = candle.time;
-                    const time_period open_period = fxlib::ForexOpenHours(curr_date);
-                    if (warning && !open_period.contains(candle.time)) {
-                        cout << "[WARN] Line: " << line_count << " - Candle date-time " << candle.time
-                             << " is out of open period " << open_period << endl;
+        }
+        vector<tuple<boost::filesystem::path, date_period>> read_list;
+        for (size_t i = 0; i < src_list.size(); i++) {
+            if (!kept[i]) {
+                read_list.push_back(src_list[i]);
+                // Hash of the source is computed again.
+                manifest.erase(string_narrow(get<0>(src_list[i]).filename().c_str()));
+            }
+        }
+        boost::optional<boost::gregorian::date> append_from;
+        if (stored.is_initialized()) {
+            append_from = get<0>(*stored);
+        }
+        const unsigned jobs = vm["jobs"].as<unsigned>();
+        vector<source_quotes> read =
+            ParseSources(read_list, pair_name, warning, allowable_gap, calendar, append_from,
+                         jobs > 0 ? jobs : max(thread::hardware_concurrency(), 1u));
+        vector<source_quotes> sources(src_list.size());
+        if (stored_format.is_initialized()) {
+            const fxlib::fxsequence_view view(string_narrow(out_path.c_str()));
+            for (size_t i = 0; i < src_list.size(); i++) {
+                if (kept[i]) {
+                    const auto& entry = manifest.at(string_narrow(get<0>(src_list[i]).filename().c_str()));
+                    sources[i] = KeepSource(view, get<1>(src_list[i]), entry);
+                }
+            }
+        }
+        for (size_t i = 0, r = 0; i < src_list.size(); i++) {
+            if (!kept[i]) {
+                sources[i] = move(read[r++]);
+            }
+        }
+        // Merging in order with checking of gaps at the seams of the files.
+        boost::optional<ptime> previous_time;
+        if (stored.is_initialized() && !get<1>(*stored).is_special()) {
+            previous_time = get<1>(*stored);
+        }
+        for (size_t i = 0; i < src_list.size(); i++) {
+            const date_period& file_period = get<1>(src_list[i]);
+            source_quotes& src = sources[i];
+            cout << (src.kept ? "Keeping " : "Reading ") << string_narrow(get<0>(src_list[i]).c_str()) << " "
+                 << file_period << "..." << endl;
+            if (!src.candles.empty()) {
+                const fxlib::fxcandle& candle = src.candles.front();
+                if (previous_time.is_initialized() && candle.time <= *previous_time) {
+                    throw "Line: " + to_string(src.first_line) + " - Wrong candle time " +
+                        to_simple_string(candle.time) + " that is less or equal previous time " +
+                        to_simple_string(*previous_time);
+                }
+                if (warning) {
+                    const time_duration delta =
+                        calendar.open_time(previous_time.value_or(ptime(file_period.begin())), candle.time);
+                    if (delta >= allowable_gap && src.first_line > 0) {
+                        cout << "[INFO] Line: " << src.first_line << " - Gap " << delta << endl;
+                    } else if (delta >= allowable_gap) {
+                        cout << "[INFO] Gap " << delta << endl;
                     }
-
-                    seq.candles.push_back(candle);
-                } catch (const std::exception& e) {
-                    ostringstream ostr;
-                    ostr << "Line: " << line_count << " - " << e.what();
-                    throw ostr.str();
                 }
-            }  // while !fin.eof()
-
-            if (!previous_time.is_initialized()) {
-                throw string("File is empty!");
+                previous_time = src.candles.back().time;
             }
-            time_duration delta = CalcLongGap(*previous_time, file_period.end());
-            if (warning && delta >= allowable_gap) {
-                cout << "[INFO] Line: " << line_count << ". Gap " << delta << endl;
+            cout << src.log;
+            if (src.error.is_initialized()) {
+                throw *src.error;
+            }
+            seq.candles.insert(seq.candles.end(), src.candles.begin(), src.candles.end());
+            src.candles = {};
+            if (warning && i + 1 == src_list.size() && previous_time.is_initialized()) {
+                const time_duration delta = calendar.open_time(*previous_time, ptime(file_period.end()));
+                if (delta >= allowable_gap && src.line_count > 0) {
+                    cout << "[INFO] Line: " << src.line_count << ". Gap " << delta << endl;
+                } else if (delta >= allowable_gap) {
+                    cout << "[INFO] Gap " << delta << endl;
+                }
             }
         }  // for src_list
 
         cout << "It has been read " << seq.candles.size() << " quotes." << endl;
-        cout << "Writing " << out_path << "..." << endl;
-
-        ofstream fout(string_narrow(out_path.c_str()), ofstream::binary);
-        if (!fout) {
-            throw "Could not open " + string_narrow(out_path.c_str());
+        if (stored.is_initialized()) {
+            cout << "Appending to " << out_path << "..." << endl;
+            fxlib::AppendSequence(string_narrow(out_path.c_str()), seq);
+        } else {
+            cout << "Writing " << out_path << "..." << endl;
+            ofstream fout(string_narrow(out_path.c_str()), ofstream::binary);
+            if (!fout) {
+                throw "Could not open " + string_narrow(out_path.c_str());
+            }
+            fxlib::fxformat format = stored_format.value_or(fxlib::fxformat::fxplain);
+            if (vm.count("compress")) {
+                format = fxlib::fxformat::fxcompressed;
+            }
+            fxlib::WriteSequence(fout, seq, format);
+            if (!fout) {
+                throw "Could not write data to " + string_narrow(out_path.c_str());
+            }
         }
-        fxlib::WriteSequence(fout, seq);
-        if (!fout) {
-            throw "Could not write data to " + string_narrow(out_path.c_str());
+        if (!pyramid_periods.empty()) {
+            // Packed candles of the stored quotes could be continued by the appended ones, so the whole file is packed.
+            cout << "Packing " << pyramid_periods.size() << " levels of the pyramid..." << endl;
+            fxlib::WritePyramid(string_narrow(out_path.c_str()), PackStoredQuotes(out_path, pyramid_periods));
         }
+        WriteManifest(manifest_path, all_sources, fxlib::fxsequence_view(string_narrow(out_path.c_str())), manifest);
     } catch (const string& e) {
         cout << "[ERROR] " << e << endl;
         return boost::system::errc::io_error;